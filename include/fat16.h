@@ -6,18 +6,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 // Constantes do sistema de arquivos
 #define SECTOR_SIZE 512
-#define CLUSTER_SIZE 1024
-#define SECTORS_PER_CLUSTER 2
-#define TOTAL_CLUSTERS 4096
-#define PARTITION_SIZE (SECTOR_SIZE * SECTORS_PER_CLUSTER * TOTAL_CLUSTERS)
-#define FAT_SIZE_BYTES (TOTAL_CLUSTERS * 2)
-#define FAT_SIZE_CLUSTERS (FAT_SIZE_BYTES / CLUSTER_SIZE)
-#define MAX_DIR_ENTRIES (CLUSTER_SIZE / sizeof(dir_entry_t))
 #define MAX_FILENAME_SIZE 18
 
+// Geometria da partição (definida no init e gravada no boot block)
+#define DEFAULT_CLUSTER_SIZE 1024
+#define DEFAULT_TOTAL_CLUSTERS 4096
+#define MIN_CLUSTER_SIZE 1024
+#define MAX_CLUSTER_SIZE 65536
+#define MAX_TOTAL_CLUSTERS 65524
+#define BOOT_MAGIC "FAT16SIM"
+
 // Valores especiais da FAT
 #define FAT_FREE 0x0000
 #define FAT_FILE_START 0x0001
@@ -26,15 +34,20 @@
 #define FAT_TABLE 0xFFFE
 #define FAT_END_OF_FILE 0xFFFF
 
+// Marcadores no primeiro byte do nome de uma entrada de diretório
+#define DIR_ENTRY_END 0x00        // Fim do diretório
+#define DIR_ENTRY_DELETED 0xE5    // Entrada removida (lápide)
+#define DIR_ENTRY_E5 0x05         // Nome que começa com o byte 0xE5
+
+
 // Atributos de arquivo
 #define ATTR_FILE 0
 #define ATTR_DIRECTORY 1
 
-// Posições na partição
+// Posições na partição (o diretório root vem logo após a FAT e os dados
+// logo após o root: ver fs->root_dir_cluster e fs->data_start_cluster)
 #define BOOT_BLOCK_CLUSTER 0
 #define FAT_START_CLUSTER 1
-#define ROOT_DIR_CLUSTER (FAT_START_CLUSTER + FAT_SIZE_CLUSTERS)
-#define DATA_START_CLUSTER (ROOT_DIR_CLUSTER + 1)
 
 // Estrutura de entrada de diretório (32 bytes)
 typedef struct {
@@ -45,47 +58,512 @@ typedef struct {
     uint32_t size;
 } dir_entry_t;
 
-// União para manipular clusters como dados ou diretório
-typedef union {
-    dir_entry_t dir[MAX_DIR_ENTRIES];
-    uint8_t data[CLUSTER_SIZE];
-} data_cluster_t;
+// Cabeçalho gravado no início do boot block (o resto continua com 0xbb).
+// Partições sem o cabeçalho usam a geometria padrão; partições com o
+// cabeçalho antigo (sem versão, 0xbb no lugar) não têm journal.
+#define BOOT_VERSION 2
+
+typedef struct {
+    char magic[8];
+    uint32_t cluster_size;
+    uint32_t total_clusters;
+    uint32_t version;
+    uint32_t journal_clusters;  // Clusters no fim da partição reservados ao journal
+} boot_block_t;
+
+// Códigos de retorno das operações (fat16_strerror dá a mensagem). As
+// funções internas que retornam -1 em caso de falha equivalem a
+// FAT16_ERR_IO
+typedef enum {
+    FAT16_OK = 0,
+    FAT16_ERR_IO = -1,                   // Falha de leitura/escrita na partição
+    FAT16_ERR_NOT_FOUND = -2,
+    FAT16_ERR_PARENT_NOT_FOUND = -3,
+    FAT16_ERR_NOT_DIRECTORY = -4,
+    FAT16_ERR_PARENT_NOT_DIRECTORY = -5,
+    FAT16_ERR_NOT_FILE = -6,
+    FAT16_ERR_EXISTS = -7,
+    FAT16_ERR_NOT_EMPTY = -8,
+    FAT16_ERR_NO_SPACE = -9,
+    FAT16_ERR_NO_MEMORY = -10,
+    FAT16_ERR_GEOMETRY = -11,            // cluster_size/clusters fora dos limites
+    FAT16_ERR_CORRUPT = -12,             // Boot block ilegível ou partição truncada
+    FAT16_ERR_HOST = -13,                // Falha ao abrir/ler/gravar arquivo do hospedeiro
+    FAT16_ERR_INVALID = -14
+} fat16_error_t;
+
+// Modos de acesso à partição
+typedef enum {
+    FAT16_BACKEND_STDIO = 0,   // pread/pwrite no descritor da partição
+    FAT16_BACKEND_MMAP         // partição mapeada em memória
+} fat16_backend_t;
+
+#define FAT16_BACKEND_DEFAULT FAT16_BACKEND_MMAP
+
+// Clusters zerados por escrita na formatação completa
+#define FORMAT_BATCH_CLUSTERS 64
+
+// fat16_send_file: trechos por chamada writev e tamanho do buffer
+// usado quando a saída não aceita sendfile
+#define SEND_BATCH_IOV 64
+#define SEND_BUFFER_CLUSTERS 64
+
+// Tamanho dos blocos copiados pelo comando import
+#define TRANSFER_BATCH_BYTES (1 << 20)
+
+// Journal de metadados: área no fim da partição com um cabeçalho no
+// primeiro cluster e as transações em seguida. Cada transação é um
+// descritor (destinos e checksum) seguido das imagens dos clusters de
+// metadados (FAT e diretórios) alterados por um grupo de operações
+#define JOURNAL_MAGIC "FAT16JNL"
+#define JOURNAL_TXN_MAGIC "FAT16TXN"
+#define JOURNAL_BYTES (128 * 1024)
+#define JOURNAL_MIN_CLUSTERS 4
+#define JOURNAL_COMMIT_MS 100   // Intervalo máximo entre commits em grupo
+
+typedef struct {
+    char magic[8];
+    uint32_t sequence;      // Primeira transação a reaplicar
+} journal_header_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t sequence;
+    uint32_t count;         // Imagens de clusters após o descritor
+    uint32_t checksum;      // Do descritor (com este campo zerado) e das imagens
+    uint16_t clusters[];    // Destino de cada imagem
+} journal_descriptor_t;
+
+// Versão mais recente de um cluster de metadados que ainda não foi
+// gravada no lugar
+typedef struct {
+    uint16_t cluster;
+    uint32_t version;       // Muda a cada escrita; o commit só descarta a versão que gravou
+    uint8_t *data;
+} journal_entry_t;
+
+typedef struct {
+    uint16_t start;         // Primeiro cluster (0 = partição sem journal)
+    uint32_t clusters;
+    uint8_t active;         // Escritas de metadados passam pelo journal
+    uint32_t sequence;      // Número da próxima transação gravada
+    uint32_t head;          // Próxima posição livre (relativa a start)
+    uint32_t running;       // Grupo de operações em andamento
+    uint32_t committed;     // Último grupo gravado no journal
+    journal_entry_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+    int32_t *slot_of;       // Cluster -> posição em entries, ou -1
+    uint16_t *deferred;     // Clusters de diretório liberados, à espera do checkpoint
+    uint32_t *deferred_group; // Grupo em que cada um foi liberado
+    uint32_t deferred_count;
+    uint32_t deferred_capacity;
+    pthread_mutex_t lock;        // Entradas, liberações adiadas e contadores
+    pthread_mutex_t commit_lock; // Um commit por vez
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    uint8_t thread_running;
+    uint8_t stop;
+} fat16_journal_t;
+
+// Estatísticas de E/S e de latência (fat16_stats_get, fat16_stats_reset).
+// Só campos uint64_t, atualizados com operações atômicas relaxadas: o custo
+// é um par de leituras do relógio por operação medida
+#define STATS_BUCKETS 40   // Faixa b do histograma: latências em [2^(b-1), 2^b) ns
+
+// Operações com histograma de latência: as públicas e, depois delas, as
+// etapas internas em que o tempo das públicas se divide
+typedef enum {
+    FAT16_OP_STAT,
+    FAT16_OP_READDIR,
+    FAT16_OP_MKDIR,
+    FAT16_OP_CREATE,
+    FAT16_OP_UNLINK,
+    FAT16_OP_WRITE,
+    FAT16_OP_APPEND,
+    FAT16_OP_CAT,
+    FAT16_OP_IMPORT,
+    FAT16_OP_EXPORT,
+    FAT16_OP_PREAD,
+    FAT16_OP_PWRITE,
+    FAT16_OP_SYNC,
+    FAT16_OP_LOOKUP,       // fat16_find_directory_entry
+    FAT16_OP_ALLOC,        // Alocação e redimensionamento de cadeias
+    FAT16_OP_TRANSFER,     // Cópia de trechos de dados de arquivos
+    FAT16_OP_FAT_WRITE,    // fat16_write_fat
+    FAT16_OP_COMMIT,       // Commit do journal
+    FAT16_OP_COUNT
+} fat16_op_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_BUCKETS];
+} fat16_histogram_t;
+
+typedef struct {
+    uint64_t cluster_reads;         // fat16_read_cluster
+    uint64_t cluster_writes;        // fat16_write_cluster
+    uint64_t meta_writes;           // fat16_write_meta (FAT e diretórios)
+    uint64_t disk_reads;            // Chamadas de leitura no descritor da partição
+    uint64_t disk_writes;           // Chamadas de escrita no descritor da partição
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t flushes;               // fdatasync e msync
+    uint64_t fat_writes;            // fat16_write_fat que gravou algum cluster
+    uint64_t fat_clusters_written;
+    uint64_t cache_hits;            // Cache de clusters (modo stdio)
+    uint64_t cache_misses;
+    uint64_t cache_writebacks;
+    uint64_t dcache_hits;           // Cache de entradas
+    uint64_t dcache_misses;
+    uint64_t journal_commits;       // Transações com algum cluster
+    uint64_t journal_clusters;      // Clusters gravados pelo journal
+    uint64_t journal_checkpoints;
+    fat16_histogram_t ops[FAT16_OP_COUNT];
+} fat16_stats_t;
+
+// Cache de clusters (write-back, substituição CLOCK) usado no modo STDIO
+#define CACHE_CLUSTERS 64
+#define CACHE_NO_SLOT (-1)
+
+typedef struct {
+    uint16_t cluster;
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t referenced;   // Bit de referência do algoritmo CLOCK
+} cache_slot_t;
+
+typedef struct {
+    cache_slot_t slots[CACHE_CLUSTERS];
+    uint8_t *data;                       // Conteúdo dos slots (NULL = cache desativado)
+    int16_t *slot_of;                    // Cluster -> slot, ou CACHE_NO_SLOT
+    size_t hand;                         // Ponteiro do CLOCK
+    pthread_mutex_t lock;                // Protege slots e dados
+} cluster_cache_t;
+
+// Índice de clusters livres: um bit por cluster (1 = livre) e um resumo
+// com um bit por palavra do mapa que ainda tem algum cluster livre
+#define FREE_MAP_WORDS ((MAX_TOTAL_CLUSTERS + 63) / 64)
+#define FREE_SUMMARY_WORDS ((FREE_MAP_WORDS + 63) / 64)
+
+typedef struct {
+    uint64_t map[FREE_MAP_WORDS];
+    uint64_t summary[FREE_SUMMARY_WORDS];
+    uint32_t free_count;
+    uint32_t limit;         // Total de clusters da partição
+    uint16_t hint;          // Próxima busca começa aqui (next-fit)
+} free_map_t;
+
+// Cache de resolução de caminhos: (diretório pai, nome) -> entrada,
+// incluindo entradas negativas para nomes inexistentes. As consultas não
+// usam trava: cada slot tem um contador de sequência (seqlock), ímpar
+// durante uma escrita, e a leitura é refeita se ele mudou no meio da cópia
+#define DCACHE_SLOTS 512
+#define DCACHE_MISS (-1)
+#define DCACHE_NEGATIVE 0
+#define DCACHE_POSITIVE 1
+
+typedef struct {
+    uint32_t seq;
+    uint16_t parent_cluster;
+    uint8_t valid;
+    uint8_t negative;
+    char name[MAX_FILENAME_SIZE + 1];
+    dir_entry_t entry;
+} dcache_slot_t;
+
+typedef struct {
+    dcache_slot_t slots[DCACHE_SLOTS];
+    pthread_mutex_t lock;     // Serializa as escritas nos slots
+} dentry_cache_t;
+
+// Índice em memória de um diretório: cópia das entradas na ordem do disco,
+// a cadeia de clusters e uma tabela hash nome -> posição
+#define DIR_INDEX_SLOTS 32
+#define DIR_INDEX_MIN_CAPACITY 32
+
+typedef struct {
+    uint16_t first_cluster;
+    uint8_t valid;
+    uint32_t count;           // Posições usadas, incluindo lápides
+    uint32_t capacity;        // Entradas alocadas em 'entries'
+    dir_entry_t *entries;
+    uint32_t *free_slots;     // Posições com lápide, reaproveitadas em ordem LIFO
+    uint32_t deleted;         // Número de lápides
+    uint32_t free_capacity;
+    uint16_t *clusters;       // Cadeia do diretório
+    uint32_t cluster_count;
+    uint32_t *table;          // Posição + 1 de cada entrada (0 = vazio)
+    uint32_t table_size;      // Potência de 2
+    uint64_t last_used;
+    uint8_t temporary;        // Fora dos slots: liberado por fat16_dir_index_put
+} dir_index_t;
+
+// Travas de diretório: cada diretório usa a trava de leitura/escrita do
+// grupo do seu cluster inicial
+#define DIR_LOCK_STRIPES 64
+
+// Sequência de clusters consecutivos
+typedef struct {
+    uint16_t start;
+    uint32_t length;
+} fat16_extent_t;
 
 // Estrutura principal do sistema de arquivos
 typedef struct {
     FILE *partition_file;
-    uint16_t fat[TOTAL_CLUSTERS];
-    data_cluster_t current_cluster;
+    fat16_backend_t backend;   // Definido antes de fat16_init/fat16_load
+    uint8_t full_format;       // fat16_format também zera a área de dados
+    uint32_t format_cluster_size;   // Geometria usada por fat16_init (0 = padrão)
+    uint32_t format_total_clusters;
+    uint8_t *map;              // Mapeamento da partição (modo MMAP)
+    size_t map_size;
+    
+    // Geometria da partição aberta; fat16_load a lê do boot block
+    uint32_t cluster_size;
+    uint32_t total_clusters;
+    uint32_t fat_clusters;
+    uint16_t root_dir_cluster;
+    uint16_t data_start_cluster;
+    uint32_t dir_entries;      // Entradas por cluster de diretório
+    size_t partition_size;
+    
+    cluster_cache_t cache;
+    fat16_journal_t journal;
+    fat16_stats_t stats;
+    uint16_t *fat;
+    uint8_t *fat_dirty;        // Clusters da FAT alterados desde a última gravação
+    free_map_t free_map;
+    dentry_cache_t dcache;
+    dir_index_t dir_index[DIR_INDEX_SLOTS];
+    uint64_t dir_index_clock;
+    uint32_t chain_generation; // Muda quando um elo existente da FAT é desfeito
     char current_path[256];
+    
+    // Sincronização entre threads (ver fat16_lock.c). Ordem de aquisição:
+    // commit_lock do journal, ns_lock, trava de um diretório, fat_lock,
+    // dir_index_lock, travas dos caches e do journal
+    pthread_rwlock_t ns_lock;  // Leitura: cada operação; escrita: rmdir e sync
+    pthread_rwlock_t dir_locks[DIR_LOCK_STRIPES];
+    pthread_mutex_t fat_lock;  // FAT, índice de livres e geração (recursiva)
+    pthread_mutex_t dir_index_lock; // Slots de dir_index
+    uint8_t locks_ready;
 } fat16_fs_t;
 
+// Trecho contíguo da cadeia de um arquivo: clusters [start, start + length)
+// ocupam as posições [index, index + length) da cadeia
+typedef struct {
+    uint32_t index;
+    uint16_t start;
+    uint16_t length;
+} fat16_file_extent_t;
+
+// Arquivo aberto: além da posição corrente, guarda um cursor na cadeia
+// (último cluster visitado e seu índice), para que o acesso sequencial
+// avance um elo da FAT por vez, e um mapa de trechos contíguos montado no
+// primeiro salto, que resolve posições arbitrárias por busca binária.
+// Ambos valem enquanto fs->chain_generation não mudar
+typedef struct {
+    uint16_t parent_cluster;
+    char name[MAX_FILENAME_SIZE + 1];
+    uint16_t first_block;
+    uint32_t size;
+    uint32_t pos;              // Posição usada por read_file/write_file/lseek
+    uint16_t cursor_cluster;   // 0 = sem cursor
+    uint32_t cursor_index;
+    fat16_file_extent_t *extents;
+    uint32_t extent_count;     // 0 = mapa não montado
+    uint32_t extent_capacity;
+    uint32_t generation;
+} fat16_file_t;
+
+// Iterador de diretório (fat16_opendir/fat16_readdir)
+typedef struct {
+    uint16_t cluster;
+    uint32_t pos;              // Próxima posição no índice do diretório
+} fat16_dir_t;
+
+// Resultado de uma desfragmentação: extensões (trechos contíguos) das
+// cadeias dos arquivos examinados, antes e depois
+typedef struct {
+    uint32_t files;
+    uint32_t fragmented_before;    // Arquivos com mais de uma extensão
+    uint32_t fragmented_after;
+    uint32_t extents_before;
+    uint32_t extents_after;
+    uint32_t moved_files;
+    uint32_t moved_clusters;
+} fat16_defrag_report_t;
+
+// Resultado de uma verificação (fat16_fsck). Os contadores de problemas
+// valem com ou sem correção
+typedef struct {
+    uint32_t directories;
+    uint32_t files;
+    uint32_t used_clusters;        // Alcançados a partir do root
+    uint32_t bad_links;            // Elos para fora da área de dados ou para cluster livre
+    uint32_t loops;
+    uint32_t cross_links;          // Clusters em mais de uma cadeia
+    uint32_t size_mismatches;      // Tamanho que não corresponde à cadeia
+    uint32_t bad_entries;          // Entradas sem um primeiro cluster válido (removidas)
+    uint32_t orphan_clusters;      // Ocupados na FAT, mas fora de qualquer cadeia
+    uint32_t reserved_fixes;       // Boot block, FAT ou journal marcados errado
+    uint64_t elapsed_ns;
+} fat16_fsck_report_t;
+
+// Desfragmentação incremental (fat16_defrag_begin/fat16_defrag_step): cada
+// etapa realoca no máximo um arquivo, sem travas mantidas entre etapas
+#define DEFRAG_MAX_DEPTH 32
+
+typedef struct {
+    char path[256];                        // Diretório em percurso (ou o arquivo)
+    fat16_dir_t dirs[DEFRAG_MAX_DEPTH];    // Iterador de cada nível
+    int depth;                             // Nível atual (-1 = fim)
+    int single;                            // 'path' é um arquivo
+    fat16_defrag_report_t report;
+} fat16_defrag_t;
+
 // Funções principais
-int fat16_init(fat16_fs_t *fs, const char *partition_name);
-int fat16_load(fat16_fs_t *fs, const char *partition_name);
+fat16_error_t fat16_init(fat16_fs_t *fs, const char *partition_name);
+fat16_error_t fat16_load(fat16_fs_t *fs, const char *partition_name);
 int fat16_format(fat16_fs_t *fs);
 void fat16_close(fat16_fs_t *fs);
+int fat16_sync(fat16_fs_t *fs);
+fat16_error_t fat16_set_geometry(fat16_fs_t *fs, uint32_t cluster_size, uint32_t total_clusters);
+const char *fat16_strerror(fat16_error_t err);
 
 // Funções de manipulação de clusters
 int fat16_read_cluster(fat16_fs_t *fs, uint16_t cluster_num, void *buffer);
 int fat16_write_cluster(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer);
+void *fat16_cluster_alloc(fat16_fs_t *fs);
+const void *fat16_get_cluster(fat16_fs_t *fs, uint16_t cluster_num, void *buffer);
+uint8_t *fat16_cluster_ptr(fat16_fs_t *fs, uint16_t cluster_num);
+int fat16_disk_read_cluster(fat16_fs_t *fs, uint16_t cluster_num, void *buffer);
+int fat16_disk_write_cluster(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer);
+int fat16_readv_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, const struct iovec *iov, int iovcnt);
+int fat16_writev_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, const struct iovec *iov, int iovcnt);
+int fat16_read_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, void *buffer);
+int fat16_write_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, const void *buffer);
+int fat16_write_meta(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer);
 int fat16_read_fat(fat16_fs_t *fs);
 int fat16_write_fat(fat16_fs_t *fs);
+void fat16_set_fat(fat16_fs_t *fs, uint16_t cluster_num, uint16_t value);
+
+// Funções do cache de clusters
+int fat16_cache_init(fat16_fs_t *fs);
+void fat16_cache_destroy(fat16_fs_t *fs);
+int fat16_cache_read(fat16_fs_t *fs, uint16_t cluster_num, void *buffer);
+int fat16_cache_write(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer);
+int fat16_cache_flush(fat16_fs_t *fs);
+int fat16_cache_flush_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count);
+void fat16_cache_discard(fat16_fs_t *fs, uint16_t cluster_num);
+
+// Journal de metadados
+uint32_t fat16_journal_default_clusters(fat16_fs_t *fs);
+int fat16_journal_layout(fat16_fs_t *fs, uint32_t clusters);
+int fat16_journal_format(fat16_fs_t *fs);
+int fat16_journal_replay(fat16_fs_t *fs);
+int fat16_journal_start(fat16_fs_t *fs);
+void fat16_journal_stop(fat16_fs_t *fs);
+void fat16_journal_destroy(fat16_fs_t *fs);
+int fat16_journal_read(fat16_fs_t *fs, uint16_t cluster_num, void *buffer);
+int fat16_journal_write(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer);
+void fat16_journal_defer_free(fat16_fs_t *fs, uint16_t cluster_num);
+int fat16_journal_commit(fat16_fs_t *fs);
+int fat16_journal_checkpoint(fat16_fs_t *fs);
+
+// Estatísticas
+uint64_t fat16_stats_clock(void);
+void fat16_stats_add(uint64_t *counter, uint64_t n);
+void fat16_stats_record(fat16_fs_t *fs, fat16_op_t op, uint64_t start);
+void fat16_stats_get(fat16_fs_t *fs, fat16_stats_t *stats);
+void fat16_stats_reset(fat16_fs_t *fs);
+const char *fat16_op_name(fat16_op_t op);
+uint64_t fat16_histogram_percentile(const fat16_histogram_t *hist, double fraction);
+
+// Sincronização
+int fat16_locks_init(fat16_fs_t *fs);
+void fat16_locks_destroy(fat16_fs_t *fs);
+void fat16_dir_rdlock(fat16_fs_t *fs, uint16_t dir_cluster);
+void fat16_dir_wrlock(fat16_fs_t *fs, uint16_t dir_cluster);
+void fat16_dir_unlock(fat16_fs_t *fs, uint16_t dir_cluster);
+int fat16_dir_trywrlock(fat16_fs_t *fs, uint16_t dir_cluster);
+void fat16_fat_lock(fat16_fs_t *fs);
+void fat16_fat_unlock(fat16_fs_t *fs);
+uint32_t fat16_chain_generation(fat16_fs_t *fs);
+
+// Funções de alocação de clusters
+void fat16_build_free_map(fat16_fs_t *fs);
+void fat16_free_map_update(fat16_fs_t *fs, uint16_t cluster_num, int is_free);
+void fat16_free_chain(fat16_fs_t *fs, uint16_t first_cluster);
+void fat16_free_dir_chain(fat16_fs_t *fs, uint16_t first_cluster);
+uint16_t fat16_alloc_cluster(fat16_fs_t *fs);
+int fat16_next_free_extent(fat16_fs_t *fs, uint32_t from, uint16_t *start, uint32_t *length);
+int fat16_alloc_chain(fat16_fs_t *fs, uint32_t count, uint16_t goal, uint16_t *first_cluster, uint16_t *last_cluster);
+int fat16_resize_chain(fat16_fs_t *fs, uint16_t first_block, uint32_t count, uint16_t *first_cluster);
+
+// Funções do cache de entradas de diretório
+void fat16_dcache_clear(fat16_fs_t *fs);
+int fat16_dcache_lookup(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, dir_entry_t *entry);
+void fat16_dcache_insert(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, const dir_entry_t *entry);
+void fat16_dcache_invalidate(fat16_fs_t *fs, uint16_t parent_cluster, const char *name);
+
+// Funções do índice de diretórios
+void fat16_dir_index_clear(fat16_fs_t *fs);
+void fat16_dir_index_drop(fat16_fs_t *fs, uint16_t dir_cluster);
+dir_index_t *fat16_dir_index_get(fat16_fs_t *fs, uint16_t dir_cluster);
+void fat16_dir_index_put(dir_index_t *idx);
+long fat16_dir_index_find(const dir_index_t *idx, const char *name);
+uint32_t fat16_dir_index_free_slot(const dir_index_t *idx);
+int fat16_dir_index_insert(dir_index_t *idx, const dir_entry_t *entry);
+int fat16_dir_index_remove(dir_index_t *idx, uint32_t pos);
+int fat16_dir_index_push_cluster(dir_index_t *idx, uint16_t cluster_num);
+
+// Acesso a arquivos por handle (dados binários, tamanho explícito)
+fat16_file_t *fat16_open(fat16_fs_t *fs, const char *path);
+ssize_t fat16_pread(fat16_fs_t *fs, fat16_file_t *file, void *buf, size_t len, uint32_t offset);
+ssize_t fat16_pwrite(fat16_fs_t *fs, fat16_file_t *file, const void *buf, size_t len, uint32_t offset);
+ssize_t fat16_read_file(fat16_fs_t *fs, fat16_file_t *file, void *buf, size_t len);
+ssize_t fat16_write_file(fat16_fs_t *fs, fat16_file_t *file, const void *buf, size_t len);
+ssize_t fat16_send_file(fat16_fs_t *fs, fat16_file_t *file, int out_fd, uint32_t offset, size_t len);
+long fat16_lseek(fat16_fs_t *fs, fat16_file_t *file, long offset, int whence);
+void fat16_close_file(fat16_fs_t *fs, fat16_file_t *file);
 
 // Funções de manipulação de arquivos e diretórios
-int fat16_ls(fat16_fs_t *fs, const char *path);
-int fat16_mkdir(fat16_fs_t *fs, const char *path);
-int fat16_create(fat16_fs_t *fs, const char *path);
-int fat16_unlink(fat16_fs_t *fs, const char *path);
-int fat16_write(fat16_fs_t *fs, const char *data, const char *path);
-int fat16_append(fat16_fs_t *fs, const char *data, const char *path);
-int fat16_read(fat16_fs_t *fs, const char *path);
+fat16_error_t fat16_stat(fat16_fs_t *fs, const char *path, dir_entry_t *entry);
+fat16_error_t fat16_opendir(fat16_fs_t *fs, const char *path, fat16_dir_t *dir);
+int fat16_readdir(fat16_fs_t *fs, fat16_dir_t *dir, dir_entry_t *entry);
+fat16_error_t fat16_mkdir(fat16_fs_t *fs, const char *path);
+fat16_error_t fat16_create(fat16_fs_t *fs, const char *path);
+fat16_error_t fat16_unlink(fat16_fs_t *fs, const char *path);
+fat16_error_t fat16_write(fat16_fs_t *fs, const char *data, const char *path);
+fat16_error_t fat16_append(fat16_fs_t *fs, const char *data, const char *path);
+fat16_error_t fat16_cat(fat16_fs_t *fs, const char *path, int out_fd, uint32_t *size);
+fat16_error_t fat16_import(fat16_fs_t *fs, const char *host_path, const char *path, uint32_t *size);
+fat16_error_t fat16_export(fat16_fs_t *fs, const char *path, const char *host_path, uint32_t *size);
+
+// Verificação e correção da FAT e dos diretórios
+fat16_error_t fat16_fsck(fat16_fs_t *fs, int repair, fat16_fsck_report_t *report);
+
+// Desfragmentação
+fat16_error_t fat16_defrag_begin(fat16_fs_t *fs, const char *path, fat16_defrag_t *defrag);
+int fat16_defrag_step(fat16_fs_t *fs, fat16_defrag_t *defrag);
+fat16_error_t fat16_defrag(fat16_fs_t *fs, const char *path, fat16_defrag_report_t *report);
 
 // Funções auxiliares
 uint16_t fat16_find_free_cluster(fat16_fs_t *fs);
+int fat16_lookup_entry(fat16_fs_t *fs, uint16_t dir_cluster, const char *name, dir_entry_t *entry);
 int fat16_find_directory_entry(fat16_fs_t *fs, const char *path, dir_entry_t *entry, uint16_t *parent_cluster);
 int fat16_add_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, uint8_t attributes, uint16_t first_block, uint32_t size);
+int fat16_update_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, uint16_t first_block, uint32_t size);
 int fat16_remove_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name);
 void fat16_parse_path(const char *path, char *parent_path, char *filename);
+void fat16_name_encode(uint8_t *filename);
+void fat16_name_decode(uint8_t *filename);
+fat16_error_t fat16_lock_parent(fat16_fs_t *fs, const char *path, uint16_t *parent_cluster, char *name);
+void fat16_unlock_parent(fat16_fs_t *fs, uint16_t parent_cluster);
 int fat16_is_directory_empty(fat16_fs_t *fs, uint16_t cluster);
 
 #endif // FAT16_H
\ No newline at end of file
@@ -1,81 +1,296 @@
 #include "../include/fat16.h"
 
+// Define a geometria da partição e os valores derivados dela
+fat16_error_t fat16_set_geometry(fat16_fs_t *fs, uint32_t cluster_size, uint32_t total_clusters) {
+    // Potência de 2 entre MIN_CLUSTER_SIZE e MAX_CLUSTER_SIZE
+    if (cluster_size < MIN_CLUSTER_SIZE || cluster_size > MAX_CLUSTER_SIZE ||
+        (cluster_size & (cluster_size - 1)) != 0) {
+        return FAT16_ERR_GEOMETRY;
+    }
+    
+    uint32_t fat_clusters = (total_clusters * sizeof(uint16_t) + cluster_size - 1) / cluster_size;
+    
+    // Boot block, FAT, root e ao menos um cluster de dados
+    if (total_clusters > MAX_TOTAL_CLUSTERS || total_clusters < FAT_START_CLUSTER + fat_clusters + 2) {
+        return FAT16_ERR_GEOMETRY;
+    }
+    
+    fs->cluster_size = cluster_size;
+    fs->total_clusters = total_clusters;
+    fs->fat_clusters = fat_clusters;
+    fs->root_dir_cluster = FAT_START_CLUSTER + fat_clusters;
+    fs->data_start_cluster = fs->root_dir_cluster + 1;
+    fs->dir_entries = cluster_size / sizeof(dir_entry_t);
+    fs->partition_size = (size_t)cluster_size * total_clusters;
+    return FAT16_OK;
+}
+
+// Aloca a FAT em memória de acordo com a geometria
+static int fat16_alloc_fat(fat16_fs_t *fs) {
+    fs->fat = calloc(fs->fat_clusters, fs->cluster_size);
+    fs->fat_dirty = calloc(fs->fat_clusters, 1);
+    
+    if (!fs->fat || !fs->fat_dirty) {
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Mapeia a partição em memória (modo MMAP)
+static int fat16_map_partition(fat16_fs_t *fs) {
+    fs->map = mmap(NULL, fs->partition_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fileno(fs->partition_file), 0);
+    if (fs->map == MAP_FAILED) {
+        fs->map = NULL;
+        return -1;
+    }
+    
+    fs->map_size = fs->partition_size;
+    return 0;
+}
+
+// Prepara o acesso à partição já aberta e dimensionada
+static fat16_error_t fat16_open_backend(fat16_fs_t *fs) {
+    if (fat16_alloc_fat(fs) != 0) {
+        return FAT16_ERR_NO_MEMORY;
+    }
+    
+    if (fs->backend == FAT16_BACKEND_MMAP) {
+        return fat16_map_partition(fs) == 0 ? FAT16_OK : FAT16_ERR_IO;
+    }
+    
+    return fat16_cache_init(fs) == 0 ? FAT16_OK : FAT16_ERR_NO_MEMORY;
+}
+
 // Inicializa o sistema de arquivos (formatar)
-int fat16_init(fat16_fs_t *fs, const char *partition_name) {
+fat16_error_t fat16_init(fat16_fs_t *fs, const char *partition_name) {
+    uint32_t cluster_size = fs->format_cluster_size ? fs->format_cluster_size : DEFAULT_CLUSTER_SIZE;
+    uint32_t total_clusters = fs->format_total_clusters ? fs->format_total_clusters : DEFAULT_TOTAL_CLUSTERS;
+    
+    fat16_close(fs);
+    
+    if (fat16_locks_init(fs) != 0) {
+        return FAT16_ERR_NO_MEMORY;
+    }
+    
+    fat16_error_t err = fat16_set_geometry(fs, cluster_size, total_clusters);
+    if (err != FAT16_OK) {
+        return err;
+    }
+    
+    fat16_journal_layout(fs, fat16_journal_default_clusters(fs));
+    
     fs->partition_file = fopen(partition_name, "wb+");
     if (!fs->partition_file) {
-        perror("Erro ao criar arquivo de partição");
-        return -1;
+        return FAT16_ERR_HOST;
     }
     
-    if (fat16_format(fs) != 0) {
-        fclose(fs->partition_file);
-        return -1;
+    // Sem buffer do stdio: as transferências em trechos usam o descritor
+    setvbuf(fs->partition_file, NULL, _IONBF, 0);
+    
+    // Define o tamanho da partição de uma vez: o arquivo recém-truncado
+    // fica esparso e o sistema devolve zeros para os clusters não escritos
+    if (ftruncate(fileno(fs->partition_file), fs->partition_size) != 0) {
+        fat16_close(fs);
+        return FAT16_ERR_HOST;
+    }
+    
+    err = fat16_open_backend(fs);
+    if (err != FAT16_OK) {
+        fat16_close(fs);
+        return err;
+    }
+    
+    // A formatação vai direto para a partição; o journal começa depois
+    if (fat16_format(fs) != 0 || fat16_sync(fs) != 0) {
+        fat16_close(fs);
+        return FAT16_ERR_IO;
+    }
+    
+    if (fat16_journal_start(fs) != 0) {
+        fat16_close(fs);
+        return FAT16_ERR_NO_MEMORY;
     }
     
     strcpy(fs->current_path, "/");
-    return 0;
+    return FAT16_OK;
 }
 
 // Carrega um sistema de arquivos existente
-int fat16_load(fat16_fs_t *fs, const char *partition_name) {
+fat16_error_t fat16_load(fat16_fs_t *fs, const char *partition_name) {
+    fat16_close(fs);
+    
+    if (fat16_locks_init(fs) != 0) {
+        return FAT16_ERR_NO_MEMORY;
+    }
+    
     fs->partition_file = fopen(partition_name, "rb+");
     if (!fs->partition_file) {
-        perror("Erro ao abrir arquivo de partição");
-        return -1;
+        return FAT16_ERR_HOST;
+    }
+    
+    // Sem buffer do stdio: as transferências em trechos usam o descritor
+    setvbuf(fs->partition_file, NULL, _IONBF, 0);
+    
+    // A geometria vem do boot block; partições antigas (só 0xbb) usam a padrão
+    boot_block_t boot;
+    if (pread(fileno(fs->partition_file), &boot, sizeof(boot), 0) != sizeof(boot)) {
+        fat16_close(fs);
+        return FAT16_ERR_CORRUPT;
+    }
+    
+    fat16_error_t geometry;
+    uint32_t journal_clusters = 0;
+    if (memcmp(boot.magic, BOOT_MAGIC, sizeof(boot.magic)) == 0) {
+        geometry = fat16_set_geometry(fs, boot.cluster_size, boot.total_clusters);
+        if (boot.version == BOOT_VERSION) {
+            journal_clusters = boot.journal_clusters;
+        }
+    } else {
+        geometry = fat16_set_geometry(fs, DEFAULT_CLUSTER_SIZE, DEFAULT_TOTAL_CLUSTERS);
+    }
+    
+    if (geometry != FAT16_OK || fat16_journal_layout(fs, journal_clusters) != 0) {
+        fat16_close(fs);
+        return FAT16_ERR_CORRUPT;
+    }
+    
+    // O arquivo precisa cobrir a partição inteira descrita no boot block
+    struct stat st;
+    if (fstat(fileno(fs->partition_file), &st) != 0 || (size_t)st.st_size < fs->partition_size) {
+        fat16_close(fs);
+        return FAT16_ERR_CORRUPT;
+    }
+    
+    // Completa as transações que já estavam no journal, antes de qualquer
+    // leitura da FAT ou dos diretórios
+    if (fat16_journal_replay(fs) < 0) {
+        fat16_close(fs);
+        return FAT16_ERR_IO;
+    }
+    
+    fat16_error_t err = fat16_open_backend(fs);
+    if (err != FAT16_OK) {
+        fat16_close(fs);
+        return err;
     }
     
     // Carrega a FAT
     if (fat16_read_fat(fs) != 0) {
-        fclose(fs->partition_file);
-        return -1;
+        fat16_close(fs);
+        return FAT16_ERR_IO;
+    }
+    
+    if (fat16_journal_start(fs) != 0) {
+        fat16_close(fs);
+        return FAT16_ERR_NO_MEMORY;
     }
     
     strcpy(fs->current_path, "/");
+    return FAT16_OK;
+}
+
+// Zera uma faixa de clusters com escritas grandes, sem passar pelo cache
+static int fat16_zero_clusters(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count) {
+    if (fs->map) {
+        memset(fat16_cluster_ptr(fs, first_cluster), 0, (size_t)count * fs->cluster_size);
+        return 0;
+    }
+    
+    uint8_t *zeros = calloc(FORMAT_BATCH_CLUSTERS, fs->cluster_size);
+    if (!zeros) {
+        return -1;
+    }
+    
+    while (count > 0) {
+        uint32_t batch = count < FORMAT_BATCH_CLUSTERS ? count : FORMAT_BATCH_CLUSTERS;
+        if (fat16_write_run(fs, first_cluster, batch, zeros) != 0) {
+            free(zeros);
+            return -1;
+        }
+        first_cluster += batch;
+        count -= batch;
+    }
+    
+    free(zeros);
     return 0;
 }
 
-// Formata o sistema de arquivos
+// Formata o sistema de arquivos. Por padrão só grava o boot block, a FAT
+// e o diretório root: os clusters de dados livres não precisam ser
+// zerados, pois diretórios e arquivos são inicializados ao serem alocados.
+// Com fs->full_format a área de dados também é zerada.
 int fat16_format(fat16_fs_t *fs) {
-    uint8_t buffer[CLUSTER_SIZE];
+    uint8_t *buffer = fat16_cluster_alloc(fs);
+    if (!buffer) {
+        return -1;
+    }
     
-    // Inicializa o boot block (cluster 0) com 0xbb
-    memset(buffer, 0xbb, CLUSTER_SIZE);
+    // Inicializa o boot block (cluster 0) com 0xbb e grava a geometria
+    boot_block_t boot;
+    memcpy(boot.magic, BOOT_MAGIC, sizeof(boot.magic));
+    boot.cluster_size = fs->cluster_size;
+    boot.total_clusters = fs->total_clusters;
+    boot.version = BOOT_VERSION;
+    boot.journal_clusters = fs->journal.clusters;
+    
+    memset(buffer, 0xbb, fs->cluster_size);
+    memcpy(buffer, &boot, sizeof(boot));
     if (fat16_write_cluster(fs, BOOT_BLOCK_CLUSTER, buffer) != 0) {
+        free(buffer);
         return -1;
     }
     
     // Inicializa a FAT
-    memset(fs->fat, 0, sizeof(fs->fat));
+    memset(fs->fat, 0, (size_t)fs->fat_clusters * fs->cluster_size);
+    memset(fs->fat_dirty, 1, fs->fat_clusters);
     
     // Marca clusters especiais na FAT
     fs->fat[BOOT_BLOCK_CLUSTER] = FAT_BOOT_BLOCK;
     
     // Marca clusters da FAT
-    for (int i = FAT_START_CLUSTER; i < FAT_START_CLUSTER + FAT_SIZE_CLUSTERS; i++) {
+    for (uint32_t i = FAT_START_CLUSTER; i < FAT_START_CLUSTER + fs->fat_clusters; i++) {
         fs->fat[i] = FAT_TABLE;
     }
     
     // Marca o diretório root
-    fs->fat[ROOT_DIR_CLUSTER] = FAT_END_OF_FILE;
+    fs->fat[fs->root_dir_cluster] = FAT_END_OF_FILE;
+    
+    // Marca a área do journal, no fim da partição
+    for (uint32_t i = fs->journal.start; fs->journal.start && i < fs->total_clusters; i++) {
+        fs->fat[i] = FAT_TABLE;
+    }
+    
+    fs->chain_generation++;
+    fat16_build_free_map(fs);
+    fat16_dcache_clear(fs);
+    fat16_dir_index_clear(fs);
     
     // Escreve a FAT no disco
     if (fat16_write_fat(fs) != 0) {
+        free(buffer);
         return -1;
     }
     
     // Inicializa o diretório root
-    memset(buffer, 0, CLUSTER_SIZE);
-    if (fat16_write_cluster(fs, ROOT_DIR_CLUSTER, buffer) != 0) {
+    memset(buffer, 0, fs->cluster_size);
+    if (fat16_write_cluster(fs, fs->root_dir_cluster, buffer) != 0) {
+        free(buffer);
         return -1;
     }
     
-    // Inicializa o resto da partição com zeros
-    memset(buffer, 0, CLUSTER_SIZE);
-    for (uint16_t i = DATA_START_CLUSTER; i < TOTAL_CLUSTERS; i++) {
-        if (fat16_write_cluster(fs, i, buffer) != 0) {
-            return -1;
-        }
+    free(buffer);
+    
+    if (fat16_journal_format(fs) != 0) {
+        return -1;
+    }
+    
+    // Formatação completa: zera a área de dados em lotes
+    uint32_t data_end = fs->journal.start ? fs->journal.start : fs->total_clusters;
+    if (fs->full_format &&
+        fat16_zero_clusters(fs, fs->data_start_cluster, data_end - fs->data_start_cluster) != 0) {
+        return -1;
     }
     
     return 0;
@@ -83,92 +298,405 @@ int fat16_format(fat16_fs_t *fs) {
 
 // Fecha o sistema de arquivos
 void fat16_close(fat16_fs_t *fs) {
+    fat16_journal_stop(fs);
+    
+    if (fs->map) {
+        fat16_sync(fs);
+        munmap(fs->map, fs->map_size);
+        fs->map = NULL;
+        fs->map_size = 0;
+    }
+    
     if (fs->partition_file) {
+        fat16_sync(fs);
         fclose(fs->partition_file);
         fs->partition_file = NULL;
     }
+    
+    fat16_journal_destroy(fs);
+    fat16_cache_destroy(fs);
+    fat16_dir_index_clear(fs);
+    
+    free(fs->fat);
+    free(fs->fat_dirty);
+    fs->fat = NULL;
+    fs->fat_dirty = NULL;
+    
+    // As estatísticas são da partição aberta
+    fat16_stats_reset(fs);
+    fat16_locks_destroy(fs);
+}
+
+// Garante que as alterações chegaram ao arquivo de partição. Espera as
+// operações em andamento terminarem. Com journal, os metadados pendentes
+// vão numa transação e o checkpoint torna tudo durável
+int fat16_sync(fat16_fs_t *fs) {
+    if (!fs->partition_file) {
+        return -1;
+    }
+    
+    uint64_t start = fat16_stats_clock();
+    
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    
+    int result = fat16_write_fat(fs);
+    
+    if (result == 0 && fs->map) {
+        fat16_stats_add(&fs->stats.flushes, 1);
+        result = msync(fs->map, fs->map_size, MS_SYNC);
+    } else if (result == 0) {
+        result = fat16_cache_flush(fs);
+    }
+    
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    if (result == 0 && fs->journal.active) {
+        result = fat16_journal_commit(fs);
+    }
+    
+    if (result == 0 && fs->journal.active) {
+        result = fat16_journal_checkpoint(fs);
+    }
+    
+    fat16_stats_record(fs, FAT16_OP_SYNC, start);
+    return result;
+}
+
+// Aloca um buffer zerado do tamanho de um cluster
+void *fat16_cluster_alloc(fat16_fs_t *fs) {
+    return calloc(1, fs->cluster_size);
+}
+
+// Retorna um ponteiro para o cluster dentro do mapeamento (NULL no modo STDIO)
+uint8_t *fat16_cluster_ptr(fat16_fs_t *fs, uint16_t cluster_num) {
+    if (!fs->map || cluster_num >= fs->total_clusters) {
+        return NULL;
+    }
+    
+    return fs->map + (size_t)cluster_num * fs->cluster_size;
+}
+
+// Acesso somente leitura a um cluster: no modo MMAP devolve o próprio
+// mapeamento sem cópia, no modo STDIO lê o cluster para o buffer informado.
+// Metadados pendentes no journal são sempre copiados para o buffer
+const void *fat16_get_cluster(fat16_fs_t *fs, uint16_t cluster_num, void *buffer) {
+    if (fat16_journal_read(fs, cluster_num, buffer) == 0) {
+        return buffer;
+    }
+    
+    const uint8_t *ptr = fat16_cluster_ptr(fs, cluster_num);
+    if (ptr) {
+        return ptr;
+    }
+    
+    if (fs->map || fat16_read_cluster(fs, cluster_num, buffer) != 0) {
+        return NULL;
+    }
+    
+    return buffer;
 }
 
-// Lê um cluster do disco
+// Lê um cluster
 int fat16_read_cluster(fat16_fs_t *fs, uint16_t cluster_num, void *buffer) {
-    if (cluster_num >= TOTAL_CLUSTERS) {
+    if (cluster_num >= fs->total_clusters) {
         return -1;
     }
     
-    long offset = cluster_num * CLUSTER_SIZE;
-    if (fseek(fs->partition_file, offset, SEEK_SET) != 0) {
+    fat16_stats_add(&fs->stats.cluster_reads, 1);
+    
+    // Metadados ainda não gravados no lugar
+    if (fat16_journal_read(fs, cluster_num, buffer) == 0) {
+        return 0;
+    }
+    
+    if (fs->map) {
+        memcpy(buffer, fat16_cluster_ptr(fs, cluster_num), fs->cluster_size);
+        return 0;
+    }
+    
+    if (fs->cache.data) {
+        return fat16_cache_read(fs, cluster_num, buffer);
+    }
+    
+    return fat16_disk_read_cluster(fs, cluster_num, buffer);
+}
+
+// Escreve um cluster
+int fat16_write_cluster(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer) {
+    if (cluster_num >= fs->total_clusters) {
+        return -1;
+    }
+    
+    fat16_stats_add(&fs->stats.cluster_writes, 1);
+    
+    if (fs->map) {
+        // Persistido no próximo fat16_sync/fat16_close
+        memcpy(fat16_cluster_ptr(fs, cluster_num), buffer, fs->cluster_size);
+        return 0;
+    }
+    
+    if (fs->cache.data) {
+        // Gravado na partição ao ser removido do cache ou no fat16_sync
+        return fat16_cache_write(fs, cluster_num, buffer);
+    }
+    
+    return fat16_disk_write_cluster(fs, cluster_num, buffer);
+}
+
+// Escreve um cluster de metadados (FAT ou diretório): com journal, fica
+// pendente até o próximo commit
+int fat16_write_meta(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer) {
+    fat16_stats_add(&fs->stats.meta_writes, 1);
+    
+    if (fs->journal.active && cluster_num < fs->total_clusters) {
+        return fat16_journal_write(fs, cluster_num, buffer);
+    }
+    
+    return fat16_write_cluster(fs, cluster_num, buffer);
+}
+
+// Lê um cluster diretamente do arquivo de partição. Usa pread: a posição
+// do FILE é compartilhada e não pode ser usada por várias threads
+int fat16_disk_read_cluster(fat16_fs_t *fs, uint16_t cluster_num, void *buffer) {
+    off_t offset = (off_t)cluster_num * fs->cluster_size;
+    
+    fat16_stats_add(&fs->stats.disk_reads, 1);
+    fat16_stats_add(&fs->stats.bytes_read, fs->cluster_size);
+    
+    if (pread(fileno(fs->partition_file), buffer, fs->cluster_size, offset) != (ssize_t)fs->cluster_size) {
         return -1;
     }
     
-    if (fread(buffer, CLUSTER_SIZE, 1, fs->partition_file) != 1) {
+    return 0;
+}
+
+// Escreve um cluster diretamente no arquivo de partição
+int fat16_disk_write_cluster(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer) {
+    off_t offset = (off_t)cluster_num * fs->cluster_size;
+    
+    fat16_stats_add(&fs->stats.disk_writes, 1);
+    fat16_stats_add(&fs->stats.bytes_written, fs->cluster_size);
+    
+    if (pwrite(fileno(fs->partition_file), buffer, fs->cluster_size, offset) != (ssize_t)fs->cluster_size) {
         return -1;
     }
     
     return 0;
 }
 
-// Escreve um cluster no disco
-int fat16_write_cluster(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer) {
-    if (cluster_num >= TOTAL_CLUSTERS) {
+// Copia 'len' bytes entre 'data' e o vetor de buffers, a partir da
+// posição 'offset' do vetor (to_iov: de 'data' para os buffers)
+static void fat16_iov_copy(const struct iovec *iov, int iovcnt, size_t offset, uint8_t *data, size_t len, int to_iov) {
+    for (int i = 0; i < iovcnt && len > 0; i++) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        
+        size_t n = iov[i].iov_len - offset;
+        if (n > len) {
+            n = len;
+        }
+        
+        if (to_iov) {
+            memcpy((uint8_t *)iov[i].iov_base + offset, data, n);
+        } else {
+            memcpy(data, (const uint8_t *)iov[i].iov_base + offset, n);
+        }
+        
+        data += n;
+        len -= n;
+        offset = 0;
+    }
+}
+
+// Transfere um trecho da partição com preadv/pwritev, repetindo a chamada
+// enquanto a transferência for parcial
+static int fat16_disk_transfer(fat16_fs_t *fs, off_t offset, const struct iovec *iov, int iovcnt, size_t len, int write) {
+    struct iovec *cur = malloc(sizeof(struct iovec) * iovcnt);
+    if (!cur) {
         return -1;
     }
     
-    long offset = cluster_num * CLUSTER_SIZE;
-    if (fseek(fs->partition_file, offset, SEEK_SET) != 0) {
+    memcpy(cur, iov, sizeof(struct iovec) * iovcnt);
+    struct iovec *vec = cur;
+    int fd = fileno(fs->partition_file);
+    uint64_t start = fat16_stats_clock();
+    
+    while (len > 0) {
+        ssize_t n = write ? pwritev(fd, vec, iovcnt, offset) : preadv(fd, vec, iovcnt, offset);
+        if (n <= 0) {
+            free(cur);
+            return -1;
+        }
+        
+        fat16_stats_add(write ? &fs->stats.disk_writes : &fs->stats.disk_reads, 1);
+        fat16_stats_add(write ? &fs->stats.bytes_written : &fs->stats.bytes_read, n);
+        
+        len -= n;
+        offset += n;
+        
+        // Avança o vetor pelos bytes transferidos
+        while (iovcnt > 0 && (size_t)n >= vec->iov_len) {
+            n -= vec->iov_len;
+            vec++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            vec->iov_base = (uint8_t *)vec->iov_base + n;
+            vec->iov_len -= n;
+        }
+    }
+    
+    free(cur);
+    fat16_stats_record(fs, FAT16_OP_TRANSFER, start);
+    return 0;
+}
+
+// Lê 'count' clusters consecutivos para o vetor de buffers, que deve
+// somar count * cluster_size bytes. No modo STDIO é uma única chamada
+// preadv; clusters alterados no cache são antes gravados na partição
+int fat16_readv_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, const struct iovec *iov, int iovcnt) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    if ((uint32_t)first_cluster + count > fs->total_clusters) {
         return -1;
     }
     
-    if (fwrite(buffer, CLUSTER_SIZE, 1, fs->partition_file) != 1) {
+    size_t len = (size_t)count * fs->cluster_size;
+    
+    if (fs->map) {
+        uint64_t start = fat16_stats_clock();
+        fat16_iov_copy(iov, iovcnt, 0, fat16_cluster_ptr(fs, first_cluster), len, 1);
+        fat16_stats_record(fs, FAT16_OP_TRANSFER, start);
+        return 0;
+    }
+    
+    if (fs->cache.data && fat16_cache_flush_run(fs, first_cluster, count) != 0) {
         return -1;
     }
     
-    fflush(fs->partition_file);
-    return 0;
+    return fat16_disk_transfer(fs, (off_t)first_cluster * fs->cluster_size, iov, iovcnt, len, 0);
+}
+
+// Escreve 'count' clusters consecutivos a partir do vetor de buffers. No
+// modo STDIO vai direto para a partição com uma chamada pwritev, e as
+// cópias antigas desses clusters saem do cache
+int fat16_writev_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, const struct iovec *iov, int iovcnt) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    if ((uint32_t)first_cluster + count > fs->total_clusters) {
+        return -1;
+    }
+    
+    size_t len = (size_t)count * fs->cluster_size;
+    
+    if (fs->map) {
+        // Persistido no próximo fat16_sync/fat16_close
+        uint64_t start = fat16_stats_clock();
+        fat16_iov_copy(iov, iovcnt, 0, fat16_cluster_ptr(fs, first_cluster), len, 0);
+        fat16_stats_record(fs, FAT16_OP_TRANSFER, start);
+        return 0;
+    }
+    
+    if (fs->cache.data) {
+        for (uint32_t i = 0; i < count; i++) {
+            fat16_cache_discard(fs, first_cluster + i);
+        }
+    }
+    
+    return fat16_disk_transfer(fs, (off_t)first_cluster * fs->cluster_size, iov, iovcnt, len, 1);
+}
+
+// Lê clusters consecutivos para um buffer contínuo
+int fat16_read_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, void *buffer) {
+    struct iovec iov = { buffer, (size_t)count * fs->cluster_size };
+    return fat16_readv_run(fs, first_cluster, count, &iov, 1);
+}
+
+// Escreve clusters consecutivos a partir de um buffer contínuo
+int fat16_write_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count, const void *buffer) {
+    struct iovec iov = { (void *)buffer, (size_t)count * fs->cluster_size };
+    return fat16_writev_run(fs, first_cluster, count, &iov, 1);
 }
 
-// Lê a FAT do disco
+// Lê a FAT do disco (ao carregar a partição, sem outras threads)
 int fat16_read_fat(fat16_fs_t *fs) {
-    uint8_t buffer[CLUSTER_SIZE];
-    uint16_t *fat_ptr = fs->fat;
+    uint8_t *fat_ptr = (uint8_t *)fs->fat;
     
-    for (int i = 0; i < FAT_SIZE_CLUSTERS; i++) {
-        if (fat16_read_cluster(fs, FAT_START_CLUSTER + i, buffer) != 0) {
+    for (uint32_t i = 0; i < fs->fat_clusters; i++) {
+        if (fat16_read_cluster(fs, FAT_START_CLUSTER + i, fat_ptr + (size_t)i * fs->cluster_size) != 0) {
             return -1;
         }
-        
-        memcpy(fat_ptr, buffer, CLUSTER_SIZE);
-        fat_ptr += CLUSTER_SIZE / sizeof(uint16_t);
     }
     
+    memset(fs->fat_dirty, 0, fs->fat_clusters);
+    fs->chain_generation++;
+    fat16_build_free_map(fs);
+    fat16_dcache_clear(fs);
+    fat16_dir_index_clear(fs);
     return 0;
 }
 
-// Escreve a FAT no disco
+// Escreve no disco os clusters da FAT alterados
 int fat16_write_fat(fat16_fs_t *fs) {
-    uint8_t buffer[CLUSTER_SIZE];
-    uint16_t *fat_ptr = fs->fat;
+    const uint8_t *fat_ptr = (const uint8_t *)fs->fat;
+    uint64_t start = fat16_stats_clock();
+    uint32_t written = 0;
+    int result = 0;
+    
+    fat16_fat_lock(fs);
     
-    for (int i = 0; i < FAT_SIZE_CLUSTERS; i++) {
-        memcpy(buffer, fat_ptr, CLUSTER_SIZE);
+    for (uint32_t i = 0; i < fs->fat_clusters; i++) {
+        if (!fs->fat_dirty[i]) {
+            continue;
+        }
         
-        if (fat16_write_cluster(fs, FAT_START_CLUSTER + i, buffer) != 0) {
-            return -1;
+        if (fat16_write_meta(fs, FAT_START_CLUSTER + i, fat_ptr + (size_t)i * fs->cluster_size) != 0) {
+            result = -1;
+            break;
         }
         
-        fat_ptr += CLUSTER_SIZE / sizeof(uint16_t);
+        fs->fat_dirty[i] = 0;
+        written++;
     }
     
-    return 0;
+    fat16_fat_unlock(fs);
+    
+    if (written > 0) {
+        fat16_stats_add(&fs->stats.fat_writes, 1);
+        fat16_stats_add(&fs->stats.fat_clusters_written, written);
+        fat16_stats_record(fs, FAT16_OP_FAT_WRITE, start);
+    }
+    return result;
 }
 
-// Encontra um cluster livre
-uint16_t fat16_find_free_cluster(fat16_fs_t *fs) {
-    for (uint16_t i = DATA_START_CLUSTER; i < TOTAL_CLUSTERS; i++) {
-        if (fs->fat[i] == FAT_FREE) {
-            return i;
-        }
+// Altera uma entrada da FAT em memória e marca seu cluster como sujo.
+// Os elos de uma cadeia só são alterados por quem tem a trava do
+// diretório que a referencia, e podem ser lidos por ele sem a fat_lock
+void fat16_set_fat(fat16_fs_t *fs, uint16_t cluster_num, uint16_t value) {
+    fat16_fat_lock(fs);
+    
+    uint16_t old = fs->fat[cluster_num];
+    
+    if ((old == FAT_FREE) != (value == FAT_FREE)) {
+        fat16_free_map_update(fs, cluster_num, value == FAT_FREE);
     }
-    return 0;
+    
+    // Estender uma cadeia não invalida os mapas já montados; liberar um
+    // cluster ou trocar um elo existente, sim
+    if ((old != FAT_FREE && value == FAT_FREE) || (old != FAT_FREE && old != FAT_END_OF_FILE && old != value)) {
+        __atomic_add_fetch(&fs->chain_generation, 1, __ATOMIC_RELEASE);
+    }
+    
+    fs->fat[cluster_num] = value;
+    fs->fat_dirty[cluster_num / (fs->cluster_size / sizeof(uint16_t))] = 1;
+    
+    fat16_fat_unlock(fs);
 }
 
 // Separa o caminho em diretório pai e nome do arquivo
@@ -187,11 +715,64 @@ void fat16_parse_path(const char *path, char *parent_path, char *filename) {
     }
 }
 
-// Encontra uma entrada de diretório
-int fat16_find_directory_entry(fat16_fs_t *fs, const char *path, dir_entry_t *entry, uint16_t *parent_cluster) {
+// Converte o nome de uma entrada para a forma gravada no diretório. Um
+// nome que começa com o byte 0xE5 (o primeiro byte de muitos caracteres
+// UTF-8) seria lido como lápide: como na FAT, grava-se 0x05 no lugar
+void fat16_name_encode(uint8_t *filename) {
+    if (filename[0] == DIR_ENTRY_DELETED) {
+        filename[0] = DIR_ENTRY_E5;
+    }
+}
+
+// Converte o nome gravado no diretório de volta para o nome da entrada
+void fat16_name_decode(uint8_t *filename) {
+    if (filename[0] == DIR_ENTRY_E5) {
+        filename[0] = DIR_ENTRY_DELETED;
+    }
+}
+
+// Procura um nome em um diretório, consultando antes o cache de entradas
+// e depois o índice em memória do diretório. O chamador tem a trava do
+// diretório (leitura ou escrita)
+int fat16_lookup_entry(fat16_fs_t *fs, uint16_t dir_cluster, const char *name, dir_entry_t *entry) {
+    int cached = fat16_dcache_lookup(fs, dir_cluster, name, entry);
+    if (cached != DCACHE_MISS) {
+        return cached == DCACHE_POSITIVE ? 0 : -1;
+    }
+    
+    dir_index_t *idx = fat16_dir_index_get(fs, dir_cluster);
+    if (!idx) {
+        return -1;
+    }
+    
+    long pos = fat16_dir_index_find(idx, name);
+    if (pos < 0) {
+        fat16_dcache_insert(fs, dir_cluster, name, NULL);
+    } else {
+        if (entry) {
+            *entry = idx->entries[pos];
+            fat16_name_decode(entry->filename);
+        }
+        fat16_dcache_insert(fs, dir_cluster, name, &idx->entries[pos]);
+    }
+    
+    fat16_dir_index_put(idx);
+    return pos < 0 ? -1 : 0;
+}
+
+// Percorre o caminho componente a componente. Cada um é procurado primeiro
+// no cache de entradas, sem trava; só uma falta no cache trava o diretório
+// para leitura
+static int fat16_walk_path(fat16_fs_t *fs, const char *path, dir_entry_t *entry, uint16_t *parent_cluster) {
     if (strcmp(path, "/") == 0) {
-        // Diretório root
-        if (parent_cluster) *parent_cluster = ROOT_DIR_CLUSTER;
+        // Diretório root (não tem entrada própria)
+        if (entry) {
+            memset(entry, 0, sizeof(dir_entry_t));
+            entry->filename[0] = '/';
+            entry->attributes = ATTR_DIRECTORY;
+            entry->first_block = fs->root_dir_cluster;
+        }
+        if (parent_cluster) *parent_cluster = fs->root_dir_cluster;
         return 0;
     }
     
@@ -204,108 +785,285 @@ int fat16_find_directory_entry(fat16_fs_t *fs, const char *path, dir_entry_t *en
         temp_path[len - 1] = '\0';
     }
     
-    // Divide o caminho em tokens
-    char *token = strtok(temp_path, "/");
-    uint16_t current_cluster = ROOT_DIR_CLUSTER;
+    // Divide o caminho em tokens (strtok_r: várias threads resolvem caminhos)
+    char *saveptr;
+    char *token = strtok_r(temp_path, "/", &saveptr);
+    uint16_t current_cluster = fs->root_dir_cluster;
+    dir_entry_t current_entry;
     
     while (token != NULL) {
-        data_cluster_t cluster_data;
-        if (fat16_read_cluster(fs, current_cluster, &cluster_data) != 0) {
+        int cached = fat16_dcache_lookup(fs, current_cluster, token, &current_entry);
+        
+        if (cached == DCACHE_NEGATIVE) {
             return -1;
         }
         
-        int found = 0;
-        for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-            if (cluster_data.dir[i].filename[0] == 0) {
-                // Entrada vazia
-                break;
-            }
+        if (cached == DCACHE_MISS) {
+            fat16_dir_rdlock(fs, current_cluster);
+            int found = fat16_lookup_entry(fs, current_cluster, token, &current_entry);
+            fat16_dir_unlock(fs, current_cluster);
             
-            if (strncmp((char *)cluster_data.dir[i].filename, token, MAX_FILENAME_SIZE) == 0) {
-                if (entry) {
-                    *entry = cluster_data.dir[i];
-                }
-                if (parent_cluster) {
-                    *parent_cluster = current_cluster;
-                }
-                current_cluster = cluster_data.dir[i].first_block;
-                found = 1;
-                break;
+            if (found != 0) {
+                return -1;
             }
         }
         
-        if (!found) {
+        if (parent_cluster) {
+            *parent_cluster = current_cluster;
+        }
+        
+        token = strtok_r(NULL, "/", &saveptr);
+        
+        // Só é possível descer por diretórios
+        if (token != NULL && current_entry.attributes != ATTR_DIRECTORY) {
             return -1;
         }
         
-        token = strtok(NULL, "/");
+        current_cluster = current_entry.first_block;
+    }
+    
+    if (entry) {
+        *entry = current_entry;
     }
     
     return 0;
 }
 
-// Adiciona uma entrada de diretório
-int fat16_add_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, uint8_t attributes, uint16_t first_block, uint32_t size) {
-    data_cluster_t cluster_data;
+// Encontra uma entrada de diretório (tempo medido em FAT16_OP_LOOKUP).
+// O chamador não pode ter travas de diretório
+int fat16_find_directory_entry(fat16_fs_t *fs, const char *path, dir_entry_t *entry, uint16_t *parent_cluster) {
+    uint64_t start = fat16_stats_clock();
+    int result = fat16_walk_path(fs, path, entry, parent_cluster);
+    fat16_stats_record(fs, FAT16_OP_LOOKUP, start);
+    return result;
+}
+
+// Corpo de fat16_add_directory_entry, com o índice do diretório já obtido
+static int fat16_add_indexed_entry(fat16_fs_t *fs, dir_index_t *idx, uint16_t parent_cluster, const char *name,
+                                   uint8_t attributes, uint16_t first_block, uint32_t size) {
+    dir_entry_t new_entry;
+    memset(&new_entry, 0, sizeof(dir_entry_t));
+    memcpy(new_entry.filename, name, strnlen(name, MAX_FILENAME_SIZE));
+    fat16_name_encode(new_entry.filename);
+    new_entry.attributes = attributes;
+    new_entry.first_block = first_block;
+    new_entry.size = size;
     
-    if (fat16_read_cluster(fs, parent_cluster, &cluster_data) != 0) {
+    uint32_t pos = fat16_dir_index_free_slot(idx);
+    uint32_t chain_pos = pos / fs->dir_entries;
+    uint16_t cluster;
+    uint16_t new_cluster = 0;
+    dir_entry_t *dir = fat16_cluster_alloc(fs);
+    if (!dir) {
         return -1;
     }
     
-    // Encontra uma entrada livre
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (cluster_data.dir[i].filename[0] == 0) {
-            // Entrada livre encontrada
-            memset(&cluster_data.dir[i], 0, sizeof(dir_entry_t));
-            strncpy((char *)cluster_data.dir[i].filename, name, MAX_FILENAME_SIZE);
-            cluster_data.dir[i].attributes = attributes;
-            cluster_data.dir[i].first_block = first_block;
-            cluster_data.dir[i].size = size;
-            
-            return fat16_write_cluster(fs, parent_cluster, &cluster_data);
+    if (chain_pos < idx->cluster_count) {
+        cluster = idx->clusters[chain_pos];
+        if (fat16_read_cluster(fs, cluster, dir) != 0) {
+            free(dir);
+            return -1;
+        }
+    } else {
+        // Último cluster cheio: o diretório cresce pela FAT
+        new_cluster = fat16_alloc_cluster(fs);
+        if (new_cluster == 0) {
+            free(dir);
+            return -1;
+        }
+        cluster = new_cluster;
+    }
+    
+    dir[pos % fs->dir_entries] = new_entry;
+    
+    int result = fat16_write_meta(fs, cluster, dir);
+    free(dir);
+    
+    if (result != 0) {
+        if (new_cluster != 0) {
+            fat16_set_fat(fs, new_cluster, FAT_FREE);
         }
+        fat16_dcache_invalidate(fs, parent_cluster, name);
+        return -1;
     }
     
-    return -1;
+    if (new_cluster != 0) {
+        fat16_set_fat(fs, idx->clusters[idx->cluster_count - 1], new_cluster);
+    }
+    
+    // O índice é só um espelho do disco: se não puder ser atualizado,
+    // é descartado e remontado no próximo acesso
+    if ((new_cluster != 0 && fat16_dir_index_push_cluster(idx, new_cluster) != 0) ||
+        fat16_dir_index_insert(idx, &new_entry) != 0) {
+        fat16_dir_index_drop(fs, parent_cluster);
+    }
+    
+    fat16_dcache_insert(fs, parent_cluster, name, &new_entry);
+    return 0;
 }
 
-// Remove uma entrada de diretório
-int fat16_remove_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name) {
-    data_cluster_t cluster_data;
+// Adiciona uma entrada no diretório: reaproveita uma posição com lápide ou
+// usa o final do diretório, encadeando um novo cluster se o último está cheio
+int fat16_add_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, uint8_t attributes, uint16_t first_block, uint32_t size) {
+    dir_index_t *idx = fat16_dir_index_get(fs, parent_cluster);
+    if (!idx) {
+        return -1;
+    }
     
-    if (fat16_read_cluster(fs, parent_cluster, &cluster_data) != 0) {
+    int result = fat16_add_indexed_entry(fs, idx, parent_cluster, name, attributes, first_block, size);
+    fat16_dir_index_put(idx);
+    return result;
+}
+
+// Corpo de fat16_update_directory_entry, com o índice do diretório já obtido
+static int fat16_update_indexed_entry(fat16_fs_t *fs, dir_index_t *idx, uint16_t parent_cluster, const char *name,
+                                      uint16_t first_block, uint32_t size) {
+    long pos = fat16_dir_index_find(idx, name);
+    if (pos < 0) {
         return -1;
     }
     
-    // Encontra a entrada
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (cluster_data.dir[i].filename[0] == 0) {
-            break;
-        }
+    uint16_t cluster = idx->clusters[pos / fs->dir_entries];
+    dir_entry_t *dir = fat16_cluster_alloc(fs);
+    if (!dir) {
+        return -1;
+    }
+    
+    if (fat16_read_cluster(fs, cluster, dir) != 0) {
+        free(dir);
+        return -1;
+    }
+    
+    dir_entry_t *entry = &dir[pos % fs->dir_entries];
+    entry->first_block = first_block;
+    entry->size = size;
+    
+    if (fat16_write_meta(fs, cluster, dir) != 0) {
+        free(dir);
+        fat16_dcache_invalidate(fs, parent_cluster, name);
+        return -1;
+    }
+    
+    idx->entries[pos] = *entry;
+    fat16_dcache_insert(fs, parent_cluster, name, entry);
+    free(dir);
+    return 0;
+}
+
+// Atualiza o primeiro cluster e o tamanho de uma entrada, sem movê-la
+int fat16_update_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, uint16_t first_block, uint32_t size) {
+    dir_index_t *idx = fat16_dir_index_get(fs, parent_cluster);
+    if (!idx) {
+        return -1;
+    }
+    
+    int result = fat16_update_indexed_entry(fs, idx, parent_cluster, name, first_block, size);
+    fat16_dir_index_put(idx);
+    return result;
+}
+
+// Reescreve o diretório com as entradas vivas no início e devolve à FAT
+// os clusters finais que ficarem sem uso
+static int fat16_compact_directory(fat16_fs_t *fs, uint16_t dir_cluster, dir_index_t *idx) {
+    uint32_t live = idx->count - idx->deleted;
+    uint32_t needed = live > 0 ? (live + fs->dir_entries - 1) / fs->dir_entries : 1;
+    uint32_t pos = 0;
+    int result = 0;
+    
+    dir_entry_t *dir = fat16_cluster_alloc(fs);
+    if (!dir) {
+        return -1;
+    }
+    
+    for (uint32_t c = 0; c < needed && result == 0; c++) {
+        memset(dir, 0, fs->cluster_size);
         
-        if (strncmp((char *)cluster_data.dir[i].filename, name, MAX_FILENAME_SIZE) == 0) {
-            // Move todas as entradas subsequentes para preencher o espaço
-            for (size_t j = i; j < MAX_DIR_ENTRIES - 1; j++) {
-                cluster_data.dir[j] = cluster_data.dir[j + 1];
+        for (size_t i = 0; i < fs->dir_entries && pos < idx->count; pos++) {
+            if (idx->entries[pos].filename[0] != DIR_ENTRY_DELETED) {
+                dir[i++] = idx->entries[pos];
             }
-            
-            // Limpa a última entrada
-            memset(&cluster_data.dir[MAX_DIR_ENTRIES - 1], 0, sizeof(dir_entry_t));
-            
-            return fat16_write_cluster(fs, parent_cluster, &cluster_data);
         }
+        
+        result = fat16_write_meta(fs, idx->clusters[c], dir);
+    }
+    
+    free(dir);
+    
+    if (result == 0 && needed < idx->cluster_count) {
+        fat16_set_fat(fs, idx->clusters[needed - 1], FAT_END_OF_FILE);
+        fat16_free_dir_chain(fs, idx->clusters[needed]);
+    }
+    
+    // As posições mudaram: o índice é remontado no próximo acesso
+    fat16_dir_index_drop(fs, dir_cluster);
+    return result;
+}
+
+// Corpo de fat16_remove_directory_entry, com o índice do diretório já obtido
+static int fat16_remove_indexed_entry(fat16_fs_t *fs, dir_index_t *idx, uint16_t parent_cluster, const char *name) {
+    long pos = fat16_dir_index_find(idx, name);
+    if (pos < 0) {
+        return -1;
+    }
+    
+    uint16_t cluster = idx->clusters[pos / fs->dir_entries];
+    dir_entry_t *dir = fat16_cluster_alloc(fs);
+    if (!dir) {
+        return -1;
+    }
+    
+    if (fat16_read_cluster(fs, cluster, dir) != 0) {
+        free(dir);
+        return -1;
+    }
+    
+    dir[pos % fs->dir_entries].filename[0] = DIR_ENTRY_DELETED;
+    
+    int result = fat16_write_meta(fs, cluster, dir);
+    free(dir);
+    
+    if (result != 0) {
+        fat16_dcache_invalidate(fs, parent_cluster, name);
+        return -1;
+    }
+    
+    fat16_dcache_insert(fs, parent_cluster, name, NULL);
+    
+    if (fat16_dir_index_remove(idx, pos) != 0) {
+        fat16_dir_index_drop(fs, parent_cluster);
+        return 0;
     }
     
-    return -1;
+    if (idx->deleted >= fs->dir_entries && idx->deleted * 2 > idx->count) {
+        return fat16_compact_directory(fs, parent_cluster, idx);
+    }
+    
+    return 0;
+}
+
+// Remove uma entrada de diretório marcando-a com lápide. Não há
+// deslocamento de entradas: o diretório só é compactado quando as lápides
+// passam de metade das posições usadas
+int fat16_remove_directory_entry(fat16_fs_t *fs, uint16_t parent_cluster, const char *name) {
+    dir_index_t *idx = fat16_dir_index_get(fs, parent_cluster);
+    if (!idx) {
+        return -1;
+    }
+    
+    int result = fat16_remove_indexed_entry(fs, idx, parent_cluster, name);
+    fat16_dir_index_put(idx);
+    return result;
 }
 
-// Verifica se um diretório está vazio
+// Verifica se um diretório está vazio (lápides não contam)
 int fat16_is_directory_empty(fat16_fs_t *fs, uint16_t cluster) {
-    data_cluster_t cluster_data;
+    dir_index_t *idx = fat16_dir_index_get(fs, cluster);
     
-    if (fat16_read_cluster(fs, cluster, &cluster_data) != 0) {
+    if (!idx) {
         return 0;
     }
     
-    return cluster_data.dir[0].filename[0] == 0;
-}
\ No newline at end of file
+    int empty = idx->count == idx->deleted;
+    fat16_dir_index_put(idx);
+    return empty;
+}
@@ -0,0 +1,379 @@
+#include "../include/fat16.h"
+
+// Reconstrói o índice de clusters livres a partir da FAT em memória
+void fat16_build_free_map(fat16_fs_t *fs) {
+    free_map_t *fm = &fs->free_map;
+    
+    memset(fm->map, 0, sizeof(fm->map));
+    memset(fm->summary, 0, sizeof(fm->summary));
+    fm->free_count = 0;
+    fm->limit = fs->total_clusters;
+    fm->hint = fs->data_start_cluster;
+    
+    for (uint32_t i = fs->data_start_cluster; i < fs->total_clusters; i++) {
+        if (fs->fat[i] == FAT_FREE) {
+            fm->map[i / 64] |= 1ULL << (i % 64);
+            fm->summary[i / 4096] |= 1ULL << ((i / 64) % 64);
+            fm->free_count++;
+        }
+    }
+}
+
+// Atualiza o índice quando um cluster muda entre livre e ocupado
+void fat16_free_map_update(fat16_fs_t *fs, uint16_t cluster_num, int is_free) {
+    free_map_t *fm = &fs->free_map;
+    size_t word = cluster_num / 64;
+    
+    if (cluster_num < fs->data_start_cluster) {
+        return;
+    }
+    
+    if (is_free) {
+        fm->map[word] |= 1ULL << (cluster_num % 64);
+        fm->summary[word / 64] |= 1ULL << (word % 64);
+        fm->free_count++;
+    } else {
+        fm->map[word] &= ~(1ULL << (cluster_num % 64));
+        if (fm->map[word] == 0) {
+            fm->summary[word / 64] &= ~(1ULL << (word % 64));
+        }
+        fm->free_count--;
+    }
+}
+
+// Primeira palavra do mapa com cluster livre em [from_word, FREE_MAP_WORDS)
+static long fat16_next_free_word(const free_map_t *fm, size_t from_word) {
+    if (from_word >= FREE_MAP_WORDS) {
+        return -1;
+    }
+    
+    size_t s = from_word / 64;
+    uint64_t bits = fm->summary[s] & (~0ULL << (from_word % 64));
+    
+    while (1) {
+        if (bits) {
+            return s * 64 + __builtin_ctzll(bits);
+        }
+        if (++s >= FREE_SUMMARY_WORDS) {
+            return -1;
+        }
+        bits = fm->summary[s];
+    }
+}
+
+// Encontra um cluster livre (next-fit a partir da última alocação). O
+// cluster continua livre: com várias threads, use fat16_alloc_cluster
+uint16_t fat16_find_free_cluster(fat16_fs_t *fs) {
+    free_map_t *fm = &fs->free_map;
+    
+    if (fm->free_count == 0) {
+        return 0;
+    }
+    
+    // Restante da palavra onde está a dica
+    size_t word = fm->hint / 64;
+    uint64_t bits = fm->map[word] & (~0ULL << (fm->hint % 64));
+    
+    if (!bits) {
+        long next = fat16_next_free_word(fm, word + 1);
+        if (next < 0) {
+            // Volta ao início da área de dados
+            next = fat16_next_free_word(fm, 0);
+        }
+        word = next;
+        bits = fm->map[word];
+    }
+    
+    fm->hint = word * 64 + __builtin_ctzll(bits);
+    return fm->hint;
+}
+
+// Reserva um cluster livre, marcando-o como fim de cadeia (0 se não há)
+uint16_t fat16_alloc_cluster(fat16_fs_t *fs) {
+    uint64_t start = fat16_stats_clock();
+    
+    fat16_fat_lock(fs);
+    
+    uint16_t cluster = fat16_find_free_cluster(fs);
+    if (cluster != 0) {
+        fat16_set_fat(fs, cluster, FAT_END_OF_FILE);
+    }
+    
+    fat16_fat_unlock(fs);
+    fat16_stats_record(fs, FAT16_OP_ALLOC, start);
+    return cluster;
+}
+
+// Libera todos os clusters de uma cadeia
+void fat16_free_chain(fat16_fs_t *fs, uint16_t first_cluster) {
+    uint16_t current_cluster = first_cluster;
+    
+    fat16_fat_lock(fs);
+    
+    // Limitado ao número de clusters da partição (cadeias com laço)
+    for (uint32_t steps = 0; steps < fs->total_clusters &&
+         current_cluster >= FAT_FILE_START && current_cluster < fs->total_clusters; steps++) {
+        uint16_t next_cluster = fs->fat[current_cluster];
+        fat16_set_fat(fs, current_cluster, FAT_FREE);
+        current_cluster = next_cluster;
+    }
+    
+    fat16_fat_unlock(fs);
+}
+
+// Libera a cadeia de um diretório (ou a cadeia antiga de um arquivo
+// realocado pelo defrag). Com journal, os clusters só voltam a ser
+// alocáveis depois do próximo checkpoint (ver fat16_journal_defer_free)
+void fat16_free_dir_chain(fat16_fs_t *fs, uint16_t first_cluster) {
+    uint16_t current_cluster = first_cluster;
+    
+    fat16_fat_lock(fs);
+    
+    // Limitado ao número de clusters da partição (cadeias com laço)
+    for (uint32_t steps = 0; steps < fs->total_clusters &&
+         current_cluster >= FAT_FILE_START && current_cluster < fs->total_clusters; steps++) {
+        uint16_t next_cluster = fs->fat[current_cluster];
+        fat16_set_fat(fs, current_cluster, FAT_FREE);
+        if (fs->journal.active) {
+            fat16_journal_defer_free(fs, current_cluster);
+        }
+        current_cluster = next_cluster;
+    }
+    
+    fat16_fat_unlock(fs);
+}
+
+// Primeiro cluster livre em [from, limit), ou -1
+static long fat16_next_free_from(const free_map_t *fm, uint32_t from) {
+    if (from >= fm->limit) {
+        return -1;
+    }
+    
+    size_t word = from / 64;
+    uint64_t bits = fm->map[word] & (~0ULL << (from % 64));
+    
+    if (!bits) {
+        long next = fat16_next_free_word(fm, word + 1);
+        if (next < 0) {
+            return -1;
+        }
+        word = next;
+        bits = fm->map[word];
+    }
+    
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+// Primeiro cluster ocupado em [from, limit), ou limit
+static uint32_t fat16_next_used_from(const free_map_t *fm, uint32_t from) {
+    size_t word = from / 64;
+    uint64_t bits = ~fm->map[word] & (~0ULL << (from % 64));
+    
+    while (!bits) {
+        if (++word >= FREE_MAP_WORDS) {
+            return fm->limit;
+        }
+        bits = ~fm->map[word];
+    }
+    
+    uint32_t used = word * 64 + __builtin_ctzll(bits);
+    return used < fm->limit ? used : fm->limit;
+}
+
+// Encontra a próxima extensão de clusters livres a partir de 'from'
+int fat16_next_free_extent(fat16_fs_t *fs, uint32_t from, uint16_t *start, uint32_t *length) {
+    fat16_fat_lock(fs);
+    
+    long first = fat16_next_free_from(&fs->free_map, from < fs->data_start_cluster ? fs->data_start_cluster : from);
+    if (first >= 0) {
+        *start = first;
+        *length = fat16_next_used_from(&fs->free_map, first) - first;
+    }
+    
+    fat16_fat_unlock(fs);
+    return first < 0 ? -1 : 0;
+}
+
+// Ordena extensões pelo tamanho (maiores primeiro)
+static int fat16_extent_cmp_length(const void *a, const void *b) {
+    const fat16_extent_t *ea = a;
+    const fat16_extent_t *eb = b;
+    return (eb->length > ea->length) - (eb->length < ea->length);
+}
+
+// Ordena extensões pela posição na partição
+static int fat16_extent_cmp_start(const void *a, const void *b) {
+    const fat16_extent_t *ea = a;
+    const fat16_extent_t *eb = b;
+    return (ea->start > eb->start) - (ea->start < eb->start);
+}
+
+// Encadeia 'length' clusters consecutivos a partir de 'start' após 'prev'
+static uint16_t fat16_link_extent(fat16_fs_t *fs, uint16_t prev, uint16_t start, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        uint16_t cluster = start + i;
+        if (prev) {
+            fat16_set_fat(fs, prev, cluster);
+        }
+        fat16_set_fat(fs, cluster, FAT_END_OF_FILE);
+        prev = cluster;
+    }
+    return prev;
+}
+
+// Corpo de fat16_alloc_chain, com a fat_lock já obtida
+static int fat16_alloc_chain_locked(fat16_fs_t *fs, uint32_t count, uint16_t goal, uint16_t *first_cluster, uint16_t *last_cluster) {
+    free_map_t *fm = &fs->free_map;
+    uint16_t start;
+    uint32_t length;
+    
+    if (count == 0 || fm->free_count < count) {
+        return -1;
+    }
+    
+    // Continuação natural da cadeia
+    if (goal >= fs->data_start_cluster && goal < fs->total_clusters && fs->fat[goal] == FAT_FREE &&
+        fat16_next_used_from(fm, goal) - goal >= count) {
+        uint16_t last = fat16_link_extent(fs, 0, goal, count);
+        *first_cluster = goal;
+        if (last_cluster) *last_cluster = last;
+        return 0;
+    }
+    
+    // Best-fit sobre as extensões livres
+    uint16_t best_start = 0;
+    uint32_t best_length = 0;
+    uint32_t extents = 0;
+    uint32_t from = fs->data_start_cluster;
+    
+    while (fat16_next_free_extent(fs, from, &start, &length) == 0) {
+        extents++;
+        if (length >= count && (best_length == 0 || length < best_length)) {
+            best_start = start;
+            best_length = length;
+            if (length == count) {
+                break;
+            }
+        }
+        from = start + length;
+    }
+    
+    if (best_length > 0) {
+        uint16_t last = fat16_link_extent(fs, 0, best_start, count);
+        *first_cluster = best_start;
+        if (last_cluster) *last_cluster = last;
+        return 0;
+    }
+    
+    // Nenhuma extensão basta: usa as maiores primeiro
+    fat16_extent_t *list = malloc(sizeof(fat16_extent_t) * extents);
+    if (!list) {
+        return -1;
+    }
+    
+    uint32_t n = 0;
+    from = fs->data_start_cluster;
+    while (n < extents && fat16_next_free_extent(fs, from, &start, &length) == 0) {
+        list[n].start = start;
+        list[n].length = length;
+        n++;
+        from = start + length;
+    }
+    
+    qsort(list, n, sizeof(fat16_extent_t), fat16_extent_cmp_length);
+    
+    uint32_t used = 0;
+    uint32_t remaining = count;
+    while (remaining > 0) {
+        if (list[used].length > remaining) {
+            list[used].length = remaining;
+        }
+        remaining -= list[used].length;
+        used++;
+    }
+    
+    // Mantém a cadeia em ordem crescente de posição na partição
+    qsort(list, used, sizeof(fat16_extent_t), fat16_extent_cmp_start);
+    
+    uint16_t prev = 0;
+    for (uint32_t i = 0; i < used; i++) {
+        prev = fat16_link_extent(fs, prev, list[i].start, list[i].length);
+    }
+    
+    *first_cluster = list[0].start;
+    if (last_cluster) *last_cluster = prev;
+    free(list);
+    return 0;
+}
+
+// Aloca uma cadeia de 'count' clusters terminada em FAT_END_OF_FILE.
+// Usa a extensão contígua que cabe com menos sobra (best-fit), começando
+// por 'goal' quando ele inicia uma extensão suficiente; se nenhuma basta,
+// junta as maiores extensões para obter o menor número de fragmentos.
+// Não altera a FAT se não houver clusters livres suficientes.
+int fat16_alloc_chain(fat16_fs_t *fs, uint32_t count, uint16_t goal, uint16_t *first_cluster, uint16_t *last_cluster) {
+    uint64_t start = fat16_stats_clock();
+    fat16_fat_lock(fs);
+    int result = fat16_alloc_chain_locked(fs, count, goal, first_cluster, last_cluster);
+    fat16_fat_unlock(fs);
+    fat16_stats_record(fs, FAT16_OP_ALLOC, start);
+    return result;
+}
+
+// Corpo de fat16_resize_chain, com a fat_lock já obtida
+static int fat16_resize_chain_locked(fat16_fs_t *fs, uint16_t first_block, uint32_t count, uint16_t *first_cluster) {
+    uint16_t last_cluster = 0;
+    uint32_t length = 0;
+    uint16_t current_cluster = first_block;
+    
+    // Percorre até o último cluster mantido (first_block 0 = sem cadeia).
+    // Um elo para fora da partição é erro, não fim da cadeia
+    while (length < count && current_cluster != FAT_END_OF_FILE && (length > 0 || current_cluster != 0)) {
+        if (current_cluster < FAT_FILE_START || current_cluster >= fs->total_clusters) {
+            return -1;
+        }
+        
+        last_cluster = current_cluster;
+        length++;
+        current_cluster = fs->fat[current_cluster];
+    }
+    
+    if (length == count) {
+        // Encurta a cadeia (ou mantém, se já tem o tamanho certo)
+        if (last_cluster != 0) {
+            fat16_set_fat(fs, last_cluster, FAT_END_OF_FILE);
+        }
+        fat16_free_chain(fs, current_cluster);
+        *first_cluster = count > 0 ? first_block : 0;
+        return 0;
+    }
+    
+    // Estende a cadeia com os clusters que faltam
+    uint16_t first_new;
+    uint16_t goal = last_cluster ? last_cluster + 1 : 0;
+    
+    if (fat16_alloc_chain_locked(fs, count - length, goal, &first_new, NULL) != 0) {
+        return -1;
+    }
+    
+    if (last_cluster != 0) {
+        fat16_set_fat(fs, last_cluster, first_new);
+        *first_cluster = first_block;
+    } else {
+        *first_cluster = first_new;
+    }
+    
+    return 0;
+}
+
+// Ajusta uma cadeia para exatamente 'count' clusters, liberando o excesso
+// ou alocando apenas os clusters que faltam. Em caso de falha a cadeia
+// não é alterada. Retorna em 'first_cluster' o novo início (0 se vazia).
+int fat16_resize_chain(fat16_fs_t *fs, uint16_t first_block, uint32_t count, uint16_t *first_cluster) {
+    uint64_t start = fat16_stats_clock();
+    fat16_fat_lock(fs);
+    int result = fat16_resize_chain_locked(fs, first_block, count, first_cluster);
+    fat16_fat_unlock(fs);
+    fat16_stats_record(fs, FAT16_OP_ALLOC, start);
+    return result;
+}
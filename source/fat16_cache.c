@@ -0,0 +1,213 @@
+#include "../include/fat16.h"
+
+// Inicializa o cache de clusters
+int fat16_cache_init(fat16_fs_t *fs) {
+    cluster_cache_t *cache = &fs->cache;
+    
+    cache->data = malloc((size_t)fs->cluster_size * CACHE_CLUSTERS);
+    cache->slot_of = malloc(sizeof(int16_t) * fs->total_clusters);
+    if (!cache->data || !cache->slot_of) {
+        fat16_cache_destroy(fs);
+        return -1;
+    }
+    
+    memset(cache->slots, 0, sizeof(cache->slots));
+    for (size_t i = 0; i < fs->total_clusters; i++) {
+        cache->slot_of[i] = CACHE_NO_SLOT;
+    }
+    
+    cache->hand = 0;
+    return 0;
+}
+
+// Libera o cache (os clusters sujos devem ter sido gravados antes)
+void fat16_cache_destroy(fat16_fs_t *fs) {
+    free(fs->cache.data);
+    free(fs->cache.slot_of);
+    fs->cache.data = NULL;
+    fs->cache.slot_of = NULL;
+}
+
+// Dados de um slot do cache
+static uint8_t *fat16_cache_slot_data(fat16_fs_t *fs, size_t slot) {
+    return fs->cache.data + slot * fs->cluster_size;
+}
+
+// Grava um slot sujo na partição
+static int fat16_cache_writeback(fat16_fs_t *fs, size_t slot) {
+    cluster_cache_t *cache = &fs->cache;
+    
+    if (!cache->slots[slot].dirty) {
+        return 0;
+    }
+    
+    if (fat16_disk_write_cluster(fs, cache->slots[slot].cluster, fat16_cache_slot_data(fs, slot)) != 0) {
+        return -1;
+    }
+    
+    cache->slots[slot].dirty = 0;
+    fat16_stats_add(&fs->stats.cache_writebacks, 1);
+    return 0;
+}
+
+// Escolhe um slot para o cluster usando o algoritmo CLOCK
+static int fat16_cache_victim(fat16_fs_t *fs) {
+    cluster_cache_t *cache = &fs->cache;
+    
+    while (1) {
+        size_t slot = cache->hand;
+        cache->hand = (cache->hand + 1) % CACHE_CLUSTERS;
+        
+        if (!cache->slots[slot].valid) {
+            return slot;
+        }
+        
+        if (cache->slots[slot].referenced) {
+            // Segunda chance
+            cache->slots[slot].referenced = 0;
+            continue;
+        }
+        
+        if (fat16_cache_writeback(fs, slot) != 0) {
+            return CACHE_NO_SLOT;
+        }
+        
+        cache->slot_of[cache->slots[slot].cluster] = CACHE_NO_SLOT;
+        cache->slots[slot].valid = 0;
+        return slot;
+    }
+}
+
+// Associa um slot livre ao cluster
+static int fat16_cache_insert(fat16_fs_t *fs, uint16_t cluster_num) {
+    cluster_cache_t *cache = &fs->cache;
+    
+    int slot = fat16_cache_victim(fs);
+    if (slot == CACHE_NO_SLOT) {
+        return CACHE_NO_SLOT;
+    }
+    
+    cache->slots[slot].cluster = cluster_num;
+    cache->slots[slot].valid = 1;
+    cache->slots[slot].dirty = 0;
+    cache->slots[slot].referenced = 1;
+    cache->slot_of[cluster_num] = slot;
+    return slot;
+}
+
+// Lê um cluster através do cache
+int fat16_cache_read(fat16_fs_t *fs, uint16_t cluster_num, void *buffer) {
+    cluster_cache_t *cache = &fs->cache;
+    int result = 0;
+    
+    pthread_mutex_lock(&cache->lock);
+    
+    int slot = cache->slot_of[cluster_num];
+    
+    if (slot != CACHE_NO_SLOT) {
+        fat16_stats_add(&fs->stats.cache_hits, 1);
+        cache->slots[slot].referenced = 1;
+    } else {
+        fat16_stats_add(&fs->stats.cache_misses, 1);
+        slot = fat16_cache_insert(fs, cluster_num);
+        
+        if (slot != CACHE_NO_SLOT &&
+            fat16_disk_read_cluster(fs, cluster_num, fat16_cache_slot_data(fs, slot)) != 0) {
+            cache->slot_of[cluster_num] = CACHE_NO_SLOT;
+            cache->slots[slot].valid = 0;
+            slot = CACHE_NO_SLOT;
+        }
+    }
+    
+    if (slot != CACHE_NO_SLOT) {
+        memcpy(buffer, fat16_cache_slot_data(fs, slot), fs->cluster_size);
+    } else {
+        result = -1;
+    }
+    
+    pthread_mutex_unlock(&cache->lock);
+    return result;
+}
+
+// Escreve um cluster no cache; a gravação na partição é adiada
+int fat16_cache_write(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer) {
+    cluster_cache_t *cache = &fs->cache;
+    
+    pthread_mutex_lock(&cache->lock);
+    
+    int slot = cache->slot_of[cluster_num];
+    
+    if (slot != CACHE_NO_SLOT) {
+        fat16_stats_add(&fs->stats.cache_hits, 1);
+    } else {
+        // O cluster inteiro é sobrescrito, não é preciso lê-lo do disco
+        fat16_stats_add(&fs->stats.cache_misses, 1);
+        slot = fat16_cache_insert(fs, cluster_num);
+    }
+    
+    if (slot != CACHE_NO_SLOT) {
+        memcpy(fat16_cache_slot_data(fs, slot), buffer, fs->cluster_size);
+        cache->slots[slot].referenced = 1;
+        cache->slots[slot].dirty = 1;
+    }
+    
+    pthread_mutex_unlock(&cache->lock);
+    return slot != CACHE_NO_SLOT ? 0 : -1;
+}
+
+// Descarta o cluster do cache sem gravá-lo (a partição já tem dados mais novos)
+void fat16_cache_discard(fat16_fs_t *fs, uint16_t cluster_num) {
+    cluster_cache_t *cache = &fs->cache;
+    
+    pthread_mutex_lock(&cache->lock);
+    
+    int slot = cache->slot_of[cluster_num];
+    
+    if (slot != CACHE_NO_SLOT) {
+        cache->slots[slot].valid = 0;
+        cache->slots[slot].dirty = 0;
+        cache->slot_of[cluster_num] = CACHE_NO_SLOT;
+    }
+    
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Grava todos os clusters sujos na partição
+int fat16_cache_flush(fat16_fs_t *fs) {
+    int result = 0;
+    
+    if (!fs->cache.data) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&fs->cache.lock);
+    
+    for (size_t i = 0; i < CACHE_CLUSTERS && result == 0; i++) {
+        if (fs->cache.slots[i].valid && fat16_cache_writeback(fs, i) != 0) {
+            result = -1;
+        }
+    }
+    
+    pthread_mutex_unlock(&fs->cache.lock);
+    return result;
+}
+
+// Grava os clusters sujos do trecho [first_cluster, first_cluster + count),
+// antes de uma leitura direta da partição
+int fat16_cache_flush_run(fat16_fs_t *fs, uint16_t first_cluster, uint32_t count) {
+    cluster_cache_t *cache = &fs->cache;
+    int result = 0;
+    
+    pthread_mutex_lock(&cache->lock);
+    
+    for (uint32_t i = 0; i < count && result == 0; i++) {
+        int slot = cache->slot_of[first_cluster + i];
+        
+        if (slot != CACHE_NO_SLOT && fat16_cache_writeback(fs, slot) != 0) {
+            result = -1;
+        }
+    }
+    
+    pthread_mutex_unlock(&cache->lock);
+    return result;
+}
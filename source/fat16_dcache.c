@@ -0,0 +1,132 @@
+#include "../include/fat16.h"
+
+// Posição da chave (diretório pai, nome) na tabela
+static size_t fat16_dcache_slot(uint16_t parent_cluster, const char *name) {
+    uint32_t hash = 2166136261u ^ parent_cluster;
+    
+    for (size_t i = 0; i < MAX_FILENAME_SIZE && name[i]; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    
+    return hash % DCACHE_SLOTS;
+}
+
+// Copia um slot byte a byte com leituras atômicas: a cópia pode correr
+// junto com uma escrita, que o contador de sequência detecta depois
+static void fat16_dcache_load(dcache_slot_t *dst, const dcache_slot_t *src) {
+    const uint8_t *from = (const uint8_t *)src;
+    uint8_t *to = (uint8_t *)dst;
+    
+    for (size_t i = 0; i < sizeof(dcache_slot_t); i++) {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Grava o conteúdo do slot (exceto o contador) com escritas atômicas
+static void fat16_dcache_store(dcache_slot_t *dst, const dcache_slot_t *src) {
+    const uint8_t *from = (const uint8_t *)src;
+    uint8_t *to = (uint8_t *)dst;
+    
+    for (size_t i = sizeof(dst->seq); i < sizeof(dcache_slot_t); i++) {
+        __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Esvazia o cache de entradas (ao formatar ou carregar uma partição, sem
+// outras threads)
+void fat16_dcache_clear(fat16_fs_t *fs) {
+    memset(fs->dcache.slots, 0, sizeof(fs->dcache.slots));
+}
+
+// Consulta o cache: DCACHE_POSITIVE (entrada preenchida), DCACHE_NEGATIVE
+// (o nome sabidamente não existe no diretório) ou DCACHE_MISS. Não trava:
+// copia o slot e refaz a cópia se uma escrita aconteceu no meio
+int fat16_dcache_lookup(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, dir_entry_t *entry) {
+    dcache_slot_t *slot = &fs->dcache.slots[fat16_dcache_slot(parent_cluster, name)];
+    dcache_slot_t copy;
+    
+    while (1) {
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        
+        fat16_dcache_load(&copy, slot);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+            break;
+        }
+    }
+    
+    if (!copy.valid || copy.parent_cluster != parent_cluster ||
+        strncmp(copy.name, name, MAX_FILENAME_SIZE) != 0) {
+        fat16_stats_add(&fs->stats.dcache_misses, 1);
+        return DCACHE_MISS;
+    }
+    
+    fat16_stats_add(&fs->stats.dcache_hits, 1);
+    if (copy.negative) {
+        return DCACHE_NEGATIVE;
+    }
+    
+    if (entry) {
+        *entry = copy.entry;
+    }
+    return DCACHE_POSITIVE;
+}
+
+// Publica o novo conteúdo de um slot (com a trava de escrita do cache): o
+// contador fica ímpar durante a escrita para que as consultas concorrentes
+// a refaçam
+static void fat16_dcache_publish(dcache_slot_t *slot, const dcache_slot_t *value) {
+    uint32_t seq = slot->seq;
+    
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    fat16_dcache_store(slot, value);
+    
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Registra o resultado de uma busca; entry NULL grava uma entrada negativa
+void fat16_dcache_insert(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, const dir_entry_t *entry) {
+    dcache_slot_t *slot = &fs->dcache.slots[fat16_dcache_slot(parent_cluster, name)];
+    dcache_slot_t value;
+    
+    memset(&value, 0, sizeof(value));
+    value.valid = 1;
+    value.parent_cluster = parent_cluster;
+    strncpy(value.name, name, MAX_FILENAME_SIZE);
+    value.name[MAX_FILENAME_SIZE] = '\0';
+    
+    // O cache guarda a entrada com o nome já convertido de volta
+    if (entry) {
+        value.entry = *entry;
+        fat16_name_decode(value.entry.filename);
+    } else {
+        value.negative = 1;
+    }
+    
+    pthread_mutex_lock(&fs->dcache.lock);
+    fat16_dcache_publish(slot, &value);
+    pthread_mutex_unlock(&fs->dcache.lock);
+}
+
+// Descarta a chave (diretório pai, nome), se estiver no cache
+void fat16_dcache_invalidate(fat16_fs_t *fs, uint16_t parent_cluster, const char *name) {
+    dcache_slot_t *slot = &fs->dcache.slots[fat16_dcache_slot(parent_cluster, name)];
+    dcache_slot_t value;
+    
+    pthread_mutex_lock(&fs->dcache.lock);
+    
+    // Só quem tem a trava escreve nos slots, então aqui a leitura é direta
+    if (slot->valid && slot->parent_cluster == parent_cluster &&
+        strncmp(slot->name, name, MAX_FILENAME_SIZE) == 0) {
+        memset(&value, 0, sizeof(value));
+        fat16_dcache_publish(slot, &value);
+    }
+    
+    pthread_mutex_unlock(&fs->dcache.lock);
+}
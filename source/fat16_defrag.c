@@ -0,0 +1,311 @@
+#include "../include/fat16.h"
+
+// Monta os trechos contíguos da cadeia que começa em 'first_cluster'
+// (percurso limitado ao número de clusters da partição). Retorna o número
+// de trechos, ou 0 se a cadeia é inválida ou falta memória, e o total de
+// clusters em '*clusters'. O chamador libera '*runs'
+static uint32_t fat16_defrag_runs(fat16_fs_t *fs, uint16_t first_cluster, fat16_file_extent_t **runs, uint32_t *clusters) {
+    fat16_file_extent_t *list = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    uint32_t index = 0;
+    uint16_t cluster = first_cluster;
+    
+    *runs = NULL;
+    *clusters = 0;
+    
+    while (index < fs->total_clusters) {
+        if (cluster < fs->data_start_cluster || cluster >= fs->total_clusters) {
+            free(list);
+            return 0;
+        }
+        
+        fat16_file_extent_t *last = count ? &list[count - 1] : NULL;
+        
+        if (last && last->start + last->length == cluster && last->length < UINT16_MAX) {
+            last->length++;
+        } else {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                fat16_file_extent_t *grown = realloc(list, sizeof(fat16_file_extent_t) * capacity);
+                if (!grown) {
+                    free(list);
+                    return 0;
+                }
+                list = grown;
+            }
+            
+            list[count].index = index;
+            list[count].start = cluster;
+            list[count].length = 1;
+            count++;
+        }
+        
+        index++;
+        
+        if (fs->fat[cluster] == FAT_END_OF_FILE) {
+            *runs = list;
+            *clusters = index;
+            return count;
+        }
+        cluster = fs->fat[cluster];
+    }
+    
+    // Cadeia com laço
+    free(list);
+    return 0;
+}
+
+// Copia o conteúdo dos trechos 'from' para os trechos 'to' (mesmo total
+// de clusters), em blocos de até 'batch' clusters
+static int fat16_defrag_copy(fat16_fs_t *fs, const fat16_file_extent_t *from, uint32_t from_count,
+                             const fat16_file_extent_t *to, uint32_t to_count, uint8_t *buffer, uint32_t batch) {
+    uint32_t i = 0, from_done = 0;
+    uint32_t j = 0, to_done = 0;
+    
+    while (i < from_count && j < to_count) {
+        uint32_t n = from[i].length - from_done;
+        if (n > to[j].length - to_done) {
+            n = to[j].length - to_done;
+        }
+        if (n > batch) {
+            n = batch;
+        }
+        
+        if (fat16_read_run(fs, from[i].start + from_done, n, buffer) != 0 ||
+            fat16_write_run(fs, to[j].start + to_done, n, buffer) != 0) {
+            return -1;
+        }
+        
+        from_done += n;
+        to_done += n;
+        if (from_done == from[i].length) {
+            i++;
+            from_done = 0;
+        }
+        if (to_done == to[j].length) {
+            j++;
+            to_done = 0;
+        }
+    }
+    
+    return 0;
+}
+
+// Realoca a cadeia de um arquivo para extensões livres, se isso reduz o
+// número de trechos. Os dados são copiados antes de a entrada do diretório
+// apontar para a nova cadeia, e a antiga só volta a ser alocável depois do
+// próximo checkpoint do journal (como a de um diretório removido): uma
+// queda antes do commit encontra os dados no lugar antigo. Arquivos
+// removidos entre as etapas são ignorados
+static fat16_error_t fat16_defrag_file(fat16_fs_t *fs, const char *path, fat16_defrag_report_t *report) {
+    char name[MAX_FILENAME_SIZE + 1];
+    uint16_t parent_cluster;
+    dir_entry_t entry;
+    fat16_file_extent_t *old_runs = NULL;
+    fat16_file_extent_t *new_runs = NULL;
+    uint32_t clusters;
+    fat16_error_t err = FAT16_OK;
+    
+    if (fat16_lock_parent(fs, path, &parent_cluster, name) != FAT16_OK) {
+        return FAT16_OK;
+    }
+    
+    if (fat16_lookup_entry(fs, parent_cluster, name, &entry) != 0 || entry.attributes != ATTR_FILE) {
+        fat16_unlock_parent(fs, parent_cluster);
+        return FAT16_OK;
+    }
+    
+    uint32_t before = fat16_defrag_runs(fs, entry.first_block, &old_runs, &clusters);
+    uint32_t after = before;
+    uint16_t first_new;
+    
+    if (before > 1 && fat16_alloc_chain(fs, clusters, 0, &first_new, NULL) == 0) {
+        uint32_t new_clusters;
+        uint32_t batch = TRANSFER_BATCH_BYTES / fs->cluster_size;
+        if (batch == 0) {
+            batch = 1;
+        }
+        
+        uint32_t moved = fat16_defrag_runs(fs, first_new, &new_runs, &new_clusters);
+        uint8_t *buffer = moved > 0 && moved < before ? malloc((size_t)batch * fs->cluster_size) : NULL;
+        
+        if (moved == 0 || moved >= before) {
+            // Não há extensões livres que melhorem a cadeia
+            fat16_free_chain(fs, first_new);
+        } else if (!buffer) {
+            fat16_free_chain(fs, first_new);
+            err = FAT16_ERR_NO_MEMORY;
+        } else if (fat16_defrag_copy(fs, old_runs, before, new_runs, moved, buffer, batch) != 0 ||
+                   fat16_update_directory_entry(fs, parent_cluster, name, first_new, entry.size) != 0) {
+            fat16_free_chain(fs, first_new);
+            err = FAT16_ERR_IO;
+        } else {
+            fat16_free_dir_chain(fs, entry.first_block);
+            after = moved;
+            report->moved_files++;
+            report->moved_clusters += clusters;
+        }
+        
+        free(buffer);
+        
+        if (fat16_write_fat(fs) != 0 && err == FAT16_OK) {
+            err = FAT16_ERR_IO;
+        }
+    }
+    
+    fat16_unlock_parent(fs, parent_cluster);
+    
+    free(old_runs);
+    free(new_runs);
+    
+    // Cadeias inválidas não entram no relatório; arquivos vazios entram sem trechos
+    if (before > 0 || entry.first_block == 0) {
+        report->files++;
+        report->extents_before += before;
+        report->extents_after += after;
+        report->fragmented_before += before > 1;
+        report->fragmented_after += after > 1;
+    }
+    
+    return err;
+}
+
+// Monta em 'out' o caminho de 'name' dentro do diretório 'dir'
+static int fat16_defrag_join(const char *dir, const uint8_t *filename, char *out, size_t size) {
+    char name[MAX_FILENAME_SIZE + 1];
+    size_t len = strnlen((const char *)filename, MAX_FILENAME_SIZE);
+    
+    memcpy(name, filename, len);
+    name[len] = '\0';
+    
+    int n = snprintf(out, size, "%s%s%s", dir, strcmp(dir, "/") == 0 ? "" : "/", name);
+    return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+// Confere se o diretório em exame ainda está no caminho guardado: entre
+// etapas nada fica travado, e os clusters de um diretório removido podem
+// ter sido reaproveitados por dados de arquivos
+static int fat16_defrag_dir_valid(fat16_fs_t *fs, const fat16_defrag_t *defrag) {
+    dir_entry_t entry;
+    
+    return fat16_stat(fs, defrag->path, &entry) == FAT16_OK && entry.attributes == ATTR_DIRECTORY &&
+           entry.first_block == defrag->dirs[defrag->depth].cluster;
+}
+
+// Prepara a desfragmentação de um arquivo ou de uma árvore de diretórios
+// ('path' vazio ou NULL = toda a partição)
+fat16_error_t fat16_defrag_begin(fat16_fs_t *fs, const char *path, fat16_defrag_t *defrag) {
+    dir_entry_t entry;
+    
+    memset(defrag, 0, sizeof(fat16_defrag_t));
+    defrag->depth = -1;
+    
+    if (path == NULL || strlen(path) == 0) {
+        path = "/";
+    }
+    
+    if (strlen(path) >= sizeof(defrag->path)) {
+        return FAT16_ERR_INVALID;
+    }
+    
+    fat16_error_t err = fat16_stat(fs, path, &entry);
+    if (err != FAT16_OK) {
+        return err;
+    }
+    
+    strcpy(defrag->path, path);
+    
+    // Remove '/' do final se existir
+    size_t len = strlen(defrag->path);
+    if (len > 1 && defrag->path[len - 1] == '/') {
+        defrag->path[len - 1] = '\0';
+    }
+    
+    defrag->depth = 0;
+    if (entry.attributes == ATTR_FILE) {
+        defrag->single = 1;
+    } else {
+        defrag->dirs[0].cluster = entry.first_block;
+        defrag->dirs[0].pos = 0;
+    }
+    
+    return FAT16_OK;
+}
+
+// Executa uma etapa: avança pela árvore até o próximo arquivo e o realoca.
+// Retorna 1 se ainda há etapas, 0 no fim ou um código de erro negativo.
+// Entre etapas nada fica travado, então o chamador pode espaçá-las para
+// limitar a carga; diretórios além de DEFRAG_MAX_DEPTH níveis são ignorados,
+// e um diretório removido ou trocado entre etapas encerra sua subárvore
+int fat16_defrag_step(fat16_fs_t *fs, fat16_defrag_t *defrag) {
+    dir_entry_t entry;
+    char child[sizeof(defrag->path)];
+    
+    if (defrag->depth >= 0 && defrag->single) {
+        defrag->depth = -1;
+        return fat16_defrag_file(fs, defrag->path, &defrag->report);
+    }
+    
+    while (defrag->depth >= 0) {
+        int result = 0;
+        if (fat16_defrag_dir_valid(fs, defrag)) {
+            result = fat16_readdir(fs, &defrag->dirs[defrag->depth], &entry);
+        }
+        if (result < 0) {
+            return result;
+        }
+        
+        if (result == 0) {
+            // Fim do diretório (ou diretório que não existe mais): volta ao pai
+            char *slash = strrchr(defrag->path, '/');
+            if (slash == defrag->path) {
+                slash[1] = '\0';
+            } else if (slash) {
+                *slash = '\0';
+            }
+            defrag->depth--;
+            continue;
+        }
+        
+        if (fat16_defrag_join(defrag->path, entry.filename, child, sizeof(child)) != 0) {
+            continue;
+        }
+        
+        if (entry.attributes == ATTR_DIRECTORY) {
+            if (defrag->depth + 1 < DEFRAG_MAX_DEPTH) {
+                defrag->depth++;
+                defrag->dirs[defrag->depth].cluster = entry.first_block;
+                defrag->dirs[defrag->depth].pos = 0;
+                strcpy(defrag->path, child);
+            }
+            continue;
+        }
+        
+        fat16_error_t err = fat16_defrag_file(fs, child, &defrag->report);
+        return err != FAT16_OK ? err : 1;
+    }
+    
+    return 0;
+}
+
+// Desfragmenta um arquivo ou uma árvore de diretórios de uma vez
+fat16_error_t fat16_defrag(fat16_fs_t *fs, const char *path, fat16_defrag_report_t *report) {
+    fat16_defrag_t defrag;
+    
+    fat16_error_t err = fat16_defrag_begin(fs, path, &defrag);
+    int result = err == FAT16_OK ? 1 : 0;
+    
+    while (result > 0) {
+        result = fat16_defrag_step(fs, &defrag);
+    }
+    
+    if (result < 0) {
+        err = result;
+    }
+    
+    if (report) {
+        *report = defrag.report;
+    }
+    return err;
+}
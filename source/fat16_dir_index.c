@@ -0,0 +1,403 @@
+#include "../include/fat16.h"
+
+// Hash de um nome de entrada (no máximo MAX_FILENAME_SIZE caracteres)
+static uint32_t fat16_name_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    
+    for (size_t i = 0; i < MAX_FILENAME_SIZE && name[i]; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    
+    return hash;
+}
+
+// Libera a memória de um índice
+static void fat16_dir_index_free(dir_index_t *idx) {
+    free(idx->entries);
+    free(idx->free_slots);
+    free(idx->clusters);
+    free(idx->table);
+    memset(idx, 0, sizeof(dir_index_t));
+}
+
+// Insere a posição 'pos' na tabela hash (a tabela tem espaço livre)
+static void fat16_dir_index_hash_insert(dir_index_t *idx, uint32_t pos) {
+    uint32_t mask = idx->table_size - 1;
+    uint32_t i = fat16_name_hash((char *)idx->entries[pos].filename) & mask;
+    
+    while (idx->table[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    
+    idx->table[i] = pos + 1;
+}
+
+// Recria a tabela hash com pelo menos o dobro do número de entradas
+static int fat16_dir_index_rehash(dir_index_t *idx, uint32_t min_entries) {
+    uint32_t size = 16;
+    while (size < min_entries * 2) {
+        size *= 2;
+    }
+    
+    uint32_t *table = calloc(size, sizeof(uint32_t));
+    if (!table) {
+        return -1;
+    }
+    
+    free(idx->table);
+    idx->table = table;
+    idx->table_size = size;
+    
+    for (uint32_t pos = 0; pos < idx->count; pos++) {
+        if (idx->entries[pos].filename[0] != DIR_ENTRY_DELETED) {
+            fat16_dir_index_hash_insert(idx, pos);
+        }
+    }
+    
+    return 0;
+}
+
+// Posição do slot da tabela que aponta para o nome, ou -1
+static long fat16_dir_index_slot(const dir_index_t *idx, const char *name) {
+    uint32_t mask = idx->table_size - 1;
+    uint32_t i = fat16_name_hash(name) & mask;
+    
+    while (idx->table[i] != 0) {
+        const dir_entry_t *entry = &idx->entries[idx->table[i] - 1];
+        if (strncmp((char *)entry->filename, name, MAX_FILENAME_SIZE) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    
+    return -1;
+}
+
+// Remove um slot da tabela reposicionando o restante do grupo (sem lápides)
+static void fat16_dir_index_hash_delete(dir_index_t *idx, uint32_t slot) {
+    uint32_t mask = idx->table_size - 1;
+    uint32_t i = slot;
+    uint32_t j = slot;
+    
+    idx->table[i] = 0;
+    while (1) {
+        j = (j + 1) & mask;
+        if (idx->table[j] == 0) {
+            return;
+        }
+        
+        uint32_t home = fat16_name_hash((char *)idx->entries[idx->table[j] - 1].filename) & mask;
+        
+        // A entrada j só pode ir para o buraco i se sua posição ideal não
+        // estiver no intervalo circular (i, j]
+        int stays = (i <= j) ? (home > i && home <= j) : (home > i || home <= j);
+        if (!stays) {
+            idx->table[i] = idx->table[j];
+            idx->table[j] = 0;
+            i = j;
+        }
+    }
+}
+
+// Garante espaço para 'count' entradas no espelho
+static int fat16_dir_index_reserve(dir_index_t *idx, uint32_t count) {
+    if (count <= idx->capacity) {
+        return 0;
+    }
+    
+    uint32_t capacity = idx->capacity ? idx->capacity * 2 : DIR_INDEX_MIN_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    
+    dir_entry_t *entries = realloc(idx->entries, capacity * sizeof(dir_entry_t));
+    if (!entries) {
+        return -1;
+    }
+    
+    idx->entries = entries;
+    idx->capacity = capacity;
+    return 0;
+}
+
+// Registra uma posição com lápide como livre
+static int fat16_dir_index_push_free(dir_index_t *idx, uint32_t pos) {
+    if (idx->deleted == idx->free_capacity) {
+        uint32_t capacity = idx->free_capacity ? idx->free_capacity * 2 : DIR_INDEX_MIN_CAPACITY;
+        uint32_t *free_slots = realloc(idx->free_slots, capacity * sizeof(uint32_t));
+        if (!free_slots) {
+            return -1;
+        }
+        idx->free_slots = free_slots;
+        idx->free_capacity = capacity;
+    }
+    
+    idx->free_slots[idx->deleted++] = pos;
+    return 0;
+}
+
+// Lê a cadeia do diretório e monta o índice
+static int fat16_dir_index_build(fat16_fs_t *fs, dir_index_t *idx, uint16_t dir_cluster) {
+    uint16_t current_cluster = dir_cluster;
+    int ended = 0;
+    int result = 0;
+    
+    idx->first_cluster = dir_cluster;
+    
+    void *buffer = fat16_cluster_alloc(fs);
+    if (!buffer) {
+        return -1;
+    }
+    
+    // Limitado ao número de clusters da partição (cadeias com laço)
+    while (result == 0 && current_cluster >= FAT_FILE_START && current_cluster <= FAT_FILE_END &&
+           current_cluster < fs->total_clusters && idx->cluster_count < fs->total_clusters) {
+        uint16_t *clusters = realloc(idx->clusters, (idx->cluster_count + 1) * sizeof(uint16_t));
+        if (!clusters) {
+            result = -1;
+            break;
+        }
+        idx->clusters = clusters;
+        idx->clusters[idx->cluster_count++] = current_cluster;
+        
+        const dir_entry_t *dir = fat16_get_cluster(fs, current_cluster, buffer);
+        if (!dir) {
+            result = -1;
+            break;
+        }
+        
+        for (size_t i = 0; i < fs->dir_entries && !ended; i++) {
+            if (dir[i].filename[0] == 0) {
+                ended = 1;
+                break;
+            }
+            
+            if (fat16_dir_index_reserve(idx, idx->count + 1) != 0 ||
+                (dir[i].filename[0] == DIR_ENTRY_DELETED &&
+                 fat16_dir_index_push_free(idx, idx->count) != 0)) {
+                result = -1;
+                break;
+            }
+            idx->entries[idx->count++] = dir[i];
+        }
+        
+        current_cluster = fs->fat[current_cluster];
+    }
+    
+    free(buffer);
+    
+    if (result != 0 || idx->cluster_count == 0) {
+        return -1;
+    }
+    
+    if (fat16_dir_index_rehash(idx, idx->count - idx->deleted) != 0) {
+        return -1;
+    }
+    
+    idx->valid = 1;
+    return 0;
+}
+
+// Descarta todos os índices (ao formatar, carregar ou fechar a partição,
+// sem outras threads)
+void fat16_dir_index_clear(fat16_fs_t *fs) {
+    for (size_t i = 0; i < DIR_INDEX_SLOTS; i++) {
+        fat16_dir_index_free(&fs->dir_index[i]);
+    }
+}
+
+// Descarta o índice de um diretório removido ou reescrito (com a trava
+// do diretório para escrita)
+void fat16_dir_index_drop(fat16_fs_t *fs, uint16_t dir_cluster) {
+    pthread_mutex_lock(&fs->dir_index_lock);
+    
+    for (size_t i = 0; i < DIR_INDEX_SLOTS; i++) {
+        if (fs->dir_index[i].valid && fs->dir_index[i].first_cluster == dir_cluster) {
+            fat16_dir_index_free(&fs->dir_index[i]);
+        }
+    }
+    
+    pthread_mutex_unlock(&fs->dir_index_lock);
+}
+
+// Escolhe o slot para um diretório novo: um slot vazio ou o índice menos
+// usado que ninguém esteja consultando. Um índice só sai do slot se a
+// trava do seu diretório puder ser obtida para escrita naquele momento
+static dir_index_t *fat16_dir_index_victim(fat16_fs_t *fs) {
+    uint64_t floor = 0;
+    
+    for (size_t i = 0; i < DIR_INDEX_SLOTS; i++) {
+        if (!fs->dir_index[i].valid) {
+            return &fs->dir_index[i];
+        }
+    }
+    
+    // Do menos usado para o mais usado
+    for (size_t attempt = 0; attempt < DIR_INDEX_SLOTS; attempt++) {
+        dir_index_t *victim = NULL;
+        
+        for (size_t i = 0; i < DIR_INDEX_SLOTS; i++) {
+            dir_index_t *idx = &fs->dir_index[i];
+            if (idx->last_used >= floor && (!victim || idx->last_used < victim->last_used)) {
+                victim = idx;
+            }
+        }
+        
+        if (!victim) {
+            break;
+        }
+        
+        if (fat16_dir_trywrlock(fs, victim->first_cluster) == 0) {
+            uint16_t cluster = victim->first_cluster;
+            fat16_dir_index_free(victim);
+            fat16_dir_unlock(fs, cluster);
+            return victim;
+        }
+        
+        floor = victim->last_used + 1;
+    }
+    
+    return NULL;
+}
+
+// Índice do diretório que já está num slot, ou NULL (com a dir_index_lock)
+static dir_index_t *fat16_dir_index_slot_of(fat16_fs_t *fs, uint16_t dir_cluster) {
+    for (size_t i = 0; i < DIR_INDEX_SLOTS; i++) {
+        dir_index_t *idx = &fs->dir_index[i];
+        
+        if (idx->valid && idx->first_cluster == dir_cluster) {
+            idx->last_used = fs->dir_index_clock;
+            return idx;
+        }
+    }
+    
+    return NULL;
+}
+
+// Retorna o índice do diretório, montando-o no primeiro acesso. O
+// chamador tem a trava do diretório, que mantém o índice no slot
+// enquanto é usado, e o devolve com fat16_dir_index_put. A leitura do
+// diretório é feita fora da dir_index_lock, para que uma falta não
+// atrase as demais. Quando todos os slots estão ocupados e em uso, o
+// índice montado é temporário: não poder guardá-lo não faz o diretório
+// parecer vazio. NULL só por falta de memória ou erro de leitura
+dir_index_t *fat16_dir_index_get(fat16_fs_t *fs, uint16_t dir_cluster) {
+    pthread_mutex_lock(&fs->dir_index_lock);
+    fs->dir_index_clock++;
+    dir_index_t *idx = fat16_dir_index_slot_of(fs, dir_cluster);
+    pthread_mutex_unlock(&fs->dir_index_lock);
+    
+    if (idx) {
+        return idx;
+    }
+    
+    dir_index_t built;
+    memset(&built, 0, sizeof(dir_index_t));
+    
+    if (fat16_dir_index_build(fs, &built, dir_cluster) != 0) {
+        fat16_dir_index_free(&built);
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&fs->dir_index_lock);
+    
+    // Outro leitor do mesmo diretório pode ter montado o índice antes
+    idx = fat16_dir_index_slot_of(fs, dir_cluster);
+    if (idx) {
+        pthread_mutex_unlock(&fs->dir_index_lock);
+        fat16_dir_index_free(&built);
+        return idx;
+    }
+    
+    idx = fat16_dir_index_victim(fs);
+    if (idx) {
+        *idx = built;
+        idx->last_used = fs->dir_index_clock;
+    }
+    
+    pthread_mutex_unlock(&fs->dir_index_lock);
+    
+    if (!idx) {
+        idx = malloc(sizeof(dir_index_t));
+        if (!idx) {
+            fat16_dir_index_free(&built);
+            return NULL;
+        }
+        *idx = built;
+        idx->temporary = 1;
+    }
+    
+    return idx;
+}
+
+// Devolve um índice obtido com fat16_dir_index_get, liberando-o se é
+// temporário
+void fat16_dir_index_put(dir_index_t *idx) {
+    if (idx && idx->temporary) {
+        fat16_dir_index_free(idx);
+        free(idx);
+    }
+}
+
+// Posição da entrada com o nome no diretório, ou -1. O índice guarda os
+// nomes na forma gravada no diretório (ver fat16_name_encode)
+long fat16_dir_index_find(const dir_index_t *idx, const char *name) {
+    uint8_t stored[MAX_FILENAME_SIZE + 1];
+    
+    strncpy((char *)stored, name, MAX_FILENAME_SIZE);
+    stored[MAX_FILENAME_SIZE] = '\0';
+    fat16_name_encode(stored);
+    
+    long slot = fat16_dir_index_slot(idx, (const char *)stored);
+    return slot < 0 ? -1 : (long)idx->table[slot] - 1;
+}
+
+// Próxima posição livre para uma entrada nova: reaproveita a lápide mais
+// recente ou, se não houver, a posição após a última entrada
+uint32_t fat16_dir_index_free_slot(const dir_index_t *idx) {
+    return idx->deleted > 0 ? idx->free_slots[idx->deleted - 1] : idx->count;
+}
+
+// Registra a entrada gravada em fat16_dir_index_free_slot(idx)
+int fat16_dir_index_insert(dir_index_t *idx, const dir_entry_t *entry) {
+    uint32_t live = idx->count - idx->deleted;
+    uint32_t pos = fat16_dir_index_free_slot(idx);
+    
+    if (pos == idx->count && fat16_dir_index_reserve(idx, idx->count + 1) != 0) {
+        return -1;
+    }
+    
+    if ((live + 1) * 2 > idx->table_size &&
+        fat16_dir_index_rehash(idx, live + 1) != 0) {
+        return -1;
+    }
+    
+    if (pos == idx->count) {
+        idx->count++;
+    } else {
+        idx->deleted--;
+    }
+    
+    idx->entries[pos] = *entry;
+    fat16_dir_index_hash_insert(idx, pos);
+    return 0;
+}
+
+// Marca a entrada 'pos' com lápide e registra a posição como livre
+int fat16_dir_index_remove(dir_index_t *idx, uint32_t pos) {
+    fat16_dir_index_hash_delete(idx, fat16_dir_index_slot(idx, (char *)idx->entries[pos].filename));
+    idx->entries[pos].filename[0] = DIR_ENTRY_DELETED;
+    return fat16_dir_index_push_free(idx, pos);
+}
+
+// Registra um cluster acrescentado ao final da cadeia do diretório
+int fat16_dir_index_push_cluster(dir_index_t *idx, uint16_t cluster_num) {
+    uint16_t *clusters = realloc(idx->clusters, (idx->cluster_count + 1) * sizeof(uint16_t));
+    if (!clusters) {
+        return -1;
+    }
+    
+    idx->clusters = clusters;
+    idx->clusters[idx->cluster_count++] = cluster_num;
+    return 0;
+}
@@ -0,0 +1,650 @@
+#include "../include/fat16.h"
+
+// Número de clusters da cadeia do arquivo. Um arquivo vazio não tem
+// cadeia, exceto os criados antes da alocação adiada, que têm um cluster
+static uint32_t fat16_file_clusters(fat16_fs_t *fs, const fat16_file_t *file) {
+    if (file->size == 0) {
+        return file->first_block != 0 ? 1 : 0;
+    }
+    
+    return (file->size + fs->cluster_size - 1) / fs->cluster_size;
+}
+
+// Descarta o cursor e o mapa de trechos
+static void fat16_file_forget_chain(fat16_fs_t *fs, fat16_file_t *file) {
+    file->cursor_cluster = 0;
+    file->cursor_index = 0;
+    file->extent_count = 0;
+    file->generation = fat16_chain_generation(fs);
+}
+
+// Acrescenta ao mapa os clusters da cadeia a partir de 'cluster', que
+// ocupa a posição 'index'
+static int fat16_file_map_chain(fat16_fs_t *fs, fat16_file_t *file, uint16_t cluster, uint32_t index) {
+    // Limita o percurso ao número de clusters da partição (cadeias com laço)
+    for (uint32_t steps = 0; steps < fs->total_clusters; steps++) {
+        if (cluster < fs->data_start_cluster || cluster >= fs->total_clusters) {
+            break;
+        }
+        
+        fat16_file_extent_t *last = file->extent_count ? &file->extents[file->extent_count - 1] : NULL;
+        
+        if (last && last->start + last->length == cluster && last->length < UINT16_MAX) {
+            last->length++;
+        } else {
+            if (file->extent_count == file->extent_capacity) {
+                uint32_t capacity = file->extent_capacity ? file->extent_capacity * 2 : 16;
+                fat16_file_extent_t *extents = realloc(file->extents, capacity * sizeof(fat16_file_extent_t));
+                if (!extents) {
+                    file->extent_count = 0;
+                    return -1;
+                }
+                file->extents = extents;
+                file->extent_capacity = capacity;
+            }
+            
+            file->extents[file->extent_count].index = index;
+            file->extents[file->extent_count].start = cluster;
+            file->extents[file->extent_count].length = 1;
+            file->extent_count++;
+        }
+        
+        cluster = fs->fat[cluster];
+        index++;
+    }
+    
+    return 0;
+}
+
+// Resolve uma posição da cadeia por busca binária no mapa de trechos,
+// montando o mapa se necessário (0 se a posição está além da cadeia)
+static uint16_t fat16_file_map_lookup(fat16_fs_t *fs, fat16_file_t *file, uint32_t index) {
+    if (file->extent_count == 0 && fat16_file_map_chain(fs, file, file->first_block, 0) != 0) {
+        return 0;
+    }
+    
+    if (file->extent_count == 0) {
+        return 0;
+    }
+    
+    // A cadeia pode ter crescido depois da montagem: estender não muda a
+    // geração, então o mapa é completado a partir do seu último cluster
+    const fat16_file_extent_t *tail = &file->extents[file->extent_count - 1];
+    if (index >= tail->index + tail->length) {
+        uint16_t last = tail->start + tail->length - 1;
+        if (fat16_file_map_chain(fs, file, fs->fat[last], tail->index + tail->length) != 0) {
+            return 0;
+        }
+    }
+    
+    uint32_t lo = 0;
+    uint32_t hi = file->extent_count;
+    
+    // Último trecho que começa em 'index' ou antes
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (file->extents[mid].index <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    const fat16_file_extent_t *extent = &file->extents[lo];
+    if (index < extent->index || index - extent->index >= extent->length) {
+        return 0;
+    }
+    
+    return extent->start + (index - extent->index);
+}
+
+// Retorna o cluster na posição 'index' da cadeia (0 se a cadeia acaba
+// antes). O passo sequencial segue um elo da FAT a partir do cursor; os
+// demais acessos usam o mapa de trechos
+static uint16_t fat16_file_cluster_at(fat16_fs_t *fs, fat16_file_t *file, uint32_t index) {
+    uint16_t cluster = 0;
+    
+    if (file->generation != fat16_chain_generation(fs)) {
+        fat16_file_forget_chain(fs, file);
+    }
+    
+    if (file->cursor_cluster != 0 && index == file->cursor_index) {
+        return file->cursor_cluster;
+    }
+    
+    if (file->cursor_cluster != 0 && index == file->cursor_index + 1) {
+        cluster = fs->fat[file->cursor_cluster];
+    } else if (index == 0) {
+        cluster = file->first_block;
+    } else {
+        cluster = fat16_file_map_lookup(fs, file, index);
+    }
+    
+    if (cluster < fs->data_start_cluster || cluster >= fs->total_clusters) {
+        return 0;
+    }
+    
+    file->cursor_cluster = cluster;
+    file->cursor_index = index;
+    return cluster;
+}
+
+// Atualiza o handle com a entrada do diretório, que pode ter sido
+// alterada por operações feitas pelo caminho do arquivo
+static int fat16_file_refresh(fat16_fs_t *fs, fat16_file_t *file) {
+    dir_entry_t entry;
+    
+    if (fat16_lookup_entry(fs, file->parent_cluster, file->name, &entry) != 0) {
+        return -1;
+    }
+    
+    if (entry.first_block != file->first_block) {
+        file->first_block = entry.first_block;
+        fat16_file_forget_chain(fs, file);
+    }
+    
+    file->size = entry.size;
+    return 0;
+}
+
+// Abre um arquivo existente
+fat16_file_t *fat16_open(fat16_fs_t *fs, const char *path) {
+    dir_entry_t entry;
+    uint16_t parent_cluster;
+    
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    int found = fat16_find_directory_entry(fs, path, &entry, &parent_cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    if (found != 0 || entry.attributes != ATTR_FILE) {
+        return NULL;
+    }
+    
+    fat16_file_t *file = calloc(1, sizeof(fat16_file_t));
+    if (!file) {
+        return NULL;
+    }
+    
+    char parent_path[256];
+    fat16_parse_path(path, parent_path, file->name);
+    
+    file->parent_cluster = parent_cluster;
+    file->first_block = entry.first_block;
+    file->size = entry.size;
+    file->generation = fat16_chain_generation(fs);
+    return file;
+}
+
+// Trecho de clusters consecutivos da cadeia que começa na posição 'index',
+// com no máximo 'max' clusters. Retorna o comprimento (0 se a cadeia acaba
+// antes) e deixa o cursor no último cluster do trecho
+static uint32_t fat16_file_run(fat16_fs_t *fs, fat16_file_t *file, uint32_t index, uint32_t max, uint16_t *start) {
+    uint16_t cluster = fat16_file_cluster_at(fs, file, index);
+    if (cluster == 0) {
+        return 0;
+    }
+    
+    uint32_t run = 1;
+    while (run < max && fs->fat[cluster + run - 1] == cluster + run) {
+        run++;
+    }
+    
+    file->cursor_cluster = cluster + run - 1;
+    file->cursor_index = index + run - 1;
+    *start = cluster;
+    return run;
+}
+
+// Lê até 'len' bytes a partir de 'offset'; retorna os bytes lidos (0 no fim).
+// Cada trecho contíguo da cadeia é lido com uma só transferência: os
+// dados vão direto para 'buf', e as partes do primeiro e do último cluster
+// fora do intervalo pedido caem num buffer de descarte
+static ssize_t fat16_pread_locked(fat16_fs_t *fs, fat16_file_t *file, void *buf, size_t len, uint32_t offset) {
+    if (fat16_file_refresh(fs, file) != 0) {
+        return -1;
+    }
+    
+    if (offset >= file->size || len == 0) {
+        return 0;
+    }
+    
+    if (len > file->size - offset) {
+        len = file->size - offset;
+    }
+    
+    uint8_t *scratch = fat16_cluster_alloc(fs);
+    if (!scratch) {
+        return -1;
+    }
+    
+    uint8_t *out = buf;
+    size_t done = 0;
+    
+    while (done < len) {
+        uint32_t at = offset + done;
+        size_t in_cluster = at % fs->cluster_size;
+        uint32_t max = (in_cluster + (len - done) + fs->cluster_size - 1) / fs->cluster_size;
+        uint16_t start;
+        
+        uint32_t run = fat16_file_run(fs, file, at / fs->cluster_size, max, &start);
+        if (run == 0) {
+            free(scratch);
+            return -1;
+        }
+        
+        size_t run_bytes = (size_t)run * fs->cluster_size;
+        size_t n = run_bytes - in_cluster;
+        if (n > len - done) {
+            n = len - done;
+        }
+        
+        struct iovec iov[3];
+        int iovcnt = 0;
+        
+        if (in_cluster > 0) {
+            iov[iovcnt].iov_base = scratch;
+            iov[iovcnt++].iov_len = in_cluster;
+        }
+        iov[iovcnt].iov_base = out + done;
+        iov[iovcnt++].iov_len = n;
+        if (run_bytes - in_cluster - n > 0) {
+            iov[iovcnt].iov_base = scratch;
+            iov[iovcnt++].iov_len = run_bytes - in_cluster - n;
+        }
+        
+        if (fat16_readv_run(fs, start, run, iov, iovcnt) != 0) {
+            free(scratch);
+            return -1;
+        }
+        
+        done += n;
+    }
+    
+    free(scratch);
+    return done;
+}
+
+// Leitura com o diretório do arquivo travado para consulta
+ssize_t fat16_pread(fat16_fs_t *fs, fat16_file_t *file, void *buf, size_t len, uint32_t offset) {
+    uint64_t start = fat16_stats_clock();
+    
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    fat16_dir_rdlock(fs, file->parent_cluster);
+    
+    ssize_t n = fat16_pread_locked(fs, file, buf, len, offset);
+    
+    fat16_dir_unlock(fs, file->parent_cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    fat16_stats_record(fs, FAT16_OP_PREAD, start);
+    return n;
+}
+
+// Escreve parte de um cluster: lê o conteúdo atual (ou parte de zeros,
+// se o cluster é novo) e grava o cluster inteiro
+static int fat16_file_write_partial(fat16_fs_t *fs, fat16_file_t *file, uint32_t index, int is_new,
+                                    uint32_t lo, const uint8_t *data, size_t n, uint8_t *buffer) {
+    uint16_t cluster = fat16_file_cluster_at(fs, file, index);
+    if (cluster == 0) {
+        return -1;
+    }
+    
+    if (is_new) {
+        memset(buffer, 0, fs->cluster_size);
+    } else if (fat16_read_cluster(fs, cluster, buffer) != 0) {
+        return -1;
+    }
+    
+    if (n > 0) {
+        memcpy(buffer + lo, data, n);
+    }
+    return fat16_write_cluster(fs, cluster, buffer);
+}
+
+// Escreve 'len' bytes a partir de 'offset', estendendo o arquivo se
+// necessário. Um intervalo entre o fim atual e 'offset' é lido como zeros.
+// Os clusters cobertos por inteiro são gravados direto de 'buf', um trecho
+// contíguo da cadeia por transferência; só o primeiro e o último cluster,
+// se cobertos em parte, passam por leitura e regravação
+static ssize_t fat16_pwrite_locked(fat16_fs_t *fs, fat16_file_t *file, const void *buf, size_t len, uint32_t offset) {
+    if (len == 0) {
+        return 0;
+    }
+    
+    if ((uint64_t)offset + len > UINT32_MAX || fat16_file_refresh(fs, file) != 0) {
+        return -1;
+    }
+    
+    uint32_t cs = fs->cluster_size;
+    uint32_t end = offset + len;
+    uint32_t have = fat16_file_clusters(fs, file);
+    uint32_t need = (end + cs - 1) / cs;
+    uint16_t last = 0;
+    uint16_t first_new = 0;
+    
+    // Aloca os clusters que faltam, de preferência logo após o último; a
+    // primeira escrita num arquivo vazio cria a cadeia
+    if (need > have && have == 0) {
+        if (fat16_alloc_chain(fs, need, 0, &first_new, NULL) != 0) {
+            return -1;
+        }
+        file->first_block = first_new;
+        fat16_file_forget_chain(fs, file);
+    } else if (need > have) {
+        last = fat16_file_cluster_at(fs, file, have - 1);
+        if (last == 0 || fat16_alloc_chain(fs, need - have, last + 1, &first_new, NULL) != 0) {
+            return -1;
+        }
+        fat16_set_fat(fs, last, first_new);
+    }
+    
+    const uint8_t *in = buf;
+    uint32_t first = offset / cs;
+    uint32_t final = (end - 1) / cs;
+    
+    uint8_t *buffer = fat16_cluster_alloc(fs);
+    if (!buffer) {
+        goto fail;
+    }
+    
+    // Clusters novos antes de 'offset' são zerados
+    for (uint32_t i = have; i < first; i++) {
+        if (fat16_file_write_partial(fs, file, i, 1, 0, NULL, 0, buffer) != 0) {
+            goto fail;
+        }
+    }
+    
+    // Primeiro cluster coberto em parte
+    uint32_t full_from = first;
+    if (offset % cs != 0 || (first == final && end % cs != 0)) {
+        size_t n = (first == final) ? len : cs - offset % cs;
+        if (fat16_file_write_partial(fs, file, first, first >= have, offset % cs, in, n, buffer) != 0) {
+            goto fail;
+        }
+        full_from = first + 1;
+    }
+    
+    // Último cluster coberto em parte
+    uint32_t full_to = final + 1;
+    if (final >= full_from && end % cs != 0) {
+        if (fat16_file_write_partial(fs, file, final, final >= have, 0, in + ((size_t)final * cs - offset),
+                                     end % cs, buffer) != 0) {
+            goto fail;
+        }
+        full_to = final;
+    }
+    
+    // Clusters cobertos por inteiro, em trechos contíguos
+    for (uint32_t i = full_from; i < full_to; ) {
+        uint16_t start;
+        uint32_t run = fat16_file_run(fs, file, i, full_to - i, &start);
+        if (run == 0 || fat16_write_run(fs, start, run, in + ((size_t)i * cs - offset)) != 0) {
+            goto fail;
+        }
+        i += run;
+    }
+    
+    free(buffer);
+    
+    if (end > file->size) {
+        file->size = end;
+        if (fat16_update_directory_entry(fs, file->parent_cluster, file->name, file->first_block, file->size) != 0) {
+            return -1;
+        }
+    }
+    
+    if (fat16_write_fat(fs) != 0) {
+        return -1;
+    }
+    
+    return len;
+
+fail:
+    free(buffer);
+    if (first_new != 0) {
+        if (last != 0) {
+            fat16_set_fat(fs, last, FAT_END_OF_FILE);
+        } else {
+            file->first_block = 0;
+            fat16_file_forget_chain(fs, file);
+        }
+        fat16_free_chain(fs, first_new);
+    }
+    return -1;
+}
+
+// Escrita com o diretório do arquivo travado para alteração
+ssize_t fat16_pwrite(fat16_fs_t *fs, fat16_file_t *file, const void *buf, size_t len, uint32_t offset) {
+    uint64_t start = fat16_stats_clock();
+    
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    fat16_dir_wrlock(fs, file->parent_cluster);
+    
+    ssize_t n = fat16_pwrite_locked(fs, file, buf, len, offset);
+    
+    fat16_dir_unlock(fs, file->parent_cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    fat16_stats_record(fs, FAT16_OP_PWRITE, start);
+    return n;
+}
+
+// Grava todo o vetor no descritor, repetindo em escritas parciais
+static int fat16_writev_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    
+    return 0;
+}
+
+// Copia um trecho da partição para o descritor. Com sendfile a cópia
+// fica no kernel; só é usado para arquivos regulares, porque para pipes e
+// sockets o kernel repassa as páginas da partição por referência, e uma
+// escrita posterior nesses clusters alteraria dados ainda não consumidos
+static int fat16_send_range(fat16_fs_t *fs, int out_fd, int use_sendfile, off_t offset, size_t len) {
+    int in_fd = fileno(fs->partition_file);
+    uint64_t start = fat16_stats_clock();
+    
+    while (use_sendfile && len > 0) {
+        ssize_t n = sendfile(out_fd, in_fd, &offset, len);
+        if (n > 0) {
+            fat16_stats_add(&fs->stats.disk_reads, 1);
+            fat16_stats_add(&fs->stats.bytes_read, n);
+            len -= n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    
+    if (len == 0) {
+        fat16_stats_record(fs, FAT16_OP_TRANSFER, start);
+        return 0;
+    }
+    
+    size_t size = (size_t)SEND_BUFFER_CLUSTERS * fs->cluster_size;
+    uint8_t *buffer = malloc(len < size ? len : size);
+    if (!buffer) {
+        return -1;
+    }
+    
+    while (len > 0) {
+        size_t chunk = len < size ? len : size;
+        ssize_t n = pread(in_fd, buffer, chunk, offset);
+        struct iovec iov = { buffer, n > 0 ? (size_t)n : 0 };
+        if (n <= 0 || fat16_writev_all(out_fd, &iov, 1) != 0) {
+            free(buffer);
+            return -1;
+        }
+        fat16_stats_add(&fs->stats.disk_reads, 1);
+        fat16_stats_add(&fs->stats.bytes_read, n);
+        offset += n;
+        len -= n;
+    }
+    
+    free(buffer);
+    fat16_stats_record(fs, FAT16_OP_TRANSFER, start);
+    return 0;
+}
+
+// Envia até 'len' bytes do arquivo, a partir de 'offset', direto para o
+// descritor 'out_fd', sem passar por buffers intermediários: no modo MMAP,
+// writev com vetores apontando para os clusters mapeados; no modo STDIO,
+// um trecho contíguo da cadeia por vez a partir do descritor da partição
+// (sendfile, se a saída é um arquivo regular), depois de gravar os
+// clusters do trecho que estão alterados no cache. Retorna os bytes enviados
+static ssize_t fat16_send_file_locked(fat16_fs_t *fs, fat16_file_t *file, int out_fd, uint32_t offset, size_t len) {
+    if (fat16_file_refresh(fs, file) != 0) {
+        return -1;
+    }
+    
+    if (offset >= file->size || len == 0) {
+        return 0;
+    }
+    
+    if (len > file->size - offset) {
+        len = file->size - offset;
+    }
+    
+    struct stat st;
+    int use_sendfile = fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode);
+    
+    struct iovec iov[SEND_BATCH_IOV];
+    int iovcnt = 0;
+    size_t done = 0;
+    
+    while (done < len) {
+        uint32_t at = offset + done;
+        size_t in_cluster = at % fs->cluster_size;
+        uint32_t max = (in_cluster + (len - done) + fs->cluster_size - 1) / fs->cluster_size;
+        uint16_t start;
+        
+        uint32_t run = fat16_file_run(fs, file, at / fs->cluster_size, max, &start);
+        if (run == 0) {
+            return -1;
+        }
+        
+        size_t n = (size_t)run * fs->cluster_size - in_cluster;
+        if (n > len - done) {
+            n = len - done;
+        }
+        
+        if (fs->map) {
+            iov[iovcnt].iov_base = fat16_cluster_ptr(fs, start) + in_cluster;
+            iov[iovcnt++].iov_len = n;
+            
+            if (iovcnt == SEND_BATCH_IOV || done + n == len) {
+                uint64_t batch_start = fat16_stats_clock();
+                if (fat16_writev_all(out_fd, iov, iovcnt) != 0) {
+                    return -1;
+                }
+                fat16_stats_record(fs, FAT16_OP_TRANSFER, batch_start);
+                iovcnt = 0;
+            }
+        } else if (fat16_cache_flush_run(fs, start, run) != 0 ||
+                   fat16_send_range(fs, out_fd, use_sendfile, (off_t)start * fs->cluster_size + in_cluster, n) != 0) {
+            return -1;
+        }
+        
+        done += n;
+    }
+    
+    return done;
+}
+
+// Envio com o diretório do arquivo travado para consulta
+ssize_t fat16_send_file(fat16_fs_t *fs, fat16_file_t *file, int out_fd, uint32_t offset, size_t len) {
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    fat16_dir_rdlock(fs, file->parent_cluster);
+    
+    ssize_t n = fat16_send_file_locked(fs, file, out_fd, offset, len);
+    
+    fat16_dir_unlock(fs, file->parent_cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return n;
+}
+
+// Lê a partir da posição corrente e avança
+ssize_t fat16_read_file(fat16_fs_t *fs, fat16_file_t *file, void *buf, size_t len) {
+    ssize_t n = fat16_pread(fs, file, buf, len, file->pos);
+    if (n > 0) {
+        file->pos += n;
+    }
+    return n;
+}
+
+// Escreve a partir da posição corrente e avança
+ssize_t fat16_write_file(fat16_fs_t *fs, fat16_file_t *file, const void *buf, size_t len) {
+    ssize_t n = fat16_pwrite(fs, file, buf, len, file->pos);
+    if (n > 0) {
+        file->pos += n;
+    }
+    return n;
+}
+
+// Tamanho atual do arquivo, lido da entrada do diretório: outro handle ou
+// uma operação pelo caminho pode tê-lo alterado (-1 se não existe mais)
+static int64_t fat16_file_current_size(fat16_fs_t *fs, fat16_file_t *file) {
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    fat16_dir_rdlock(fs, file->parent_cluster);
+    
+    int found = fat16_file_refresh(fs, file) == 0;
+    
+    fat16_dir_unlock(fs, file->parent_cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    return found ? (int64_t)file->size : -1;
+}
+
+// Muda a posição corrente (SEEK_SET, SEEK_CUR ou SEEK_END)
+long fat16_lseek(fat16_fs_t *fs, fat16_file_t *file, long offset, int whence) {
+    int64_t base;
+    
+    switch (whence) {
+        case SEEK_SET: base = 0; break;
+        case SEEK_CUR: base = file->pos; break;
+        case SEEK_END: base = fat16_file_current_size(fs, file); break;
+        default: return -1;
+    }
+    
+    if (base < 0) {
+        return -1;
+    }
+    
+    int64_t pos = base + offset;
+    if (pos < 0 || pos > UINT32_MAX) {
+        return -1;
+    }
+    
+    file->pos = pos;
+    return pos;
+}
+
+// Fecha o arquivo (o tamanho já foi gravado a cada escrita)
+void fat16_close_file(fat16_fs_t *fs, fat16_file_t *file) {
+    (void)fs;
+    if (file) {
+        free(file->extents);
+    }
+    free(file);
+}
@@ -0,0 +1,402 @@
+#include "../include/fat16.h"
+
+// Diretório a examinar, com a entrada que o referencia (root: parent = 0)
+typedef struct {
+    uint16_t parent;
+    uint16_t cluster;
+    char name[MAX_FILENAME_SIZE + 1];
+} fsck_dir_t;
+
+// Arquivo a examinar depois da árvore de diretórios
+typedef struct {
+    uint16_t parent;
+    dir_entry_t entry;
+} fsck_file_t;
+
+// Estado de uma verificação
+typedef struct {
+    fat16_fs_t *fs;
+    int repair;
+    fat16_fsck_report_t *report;
+    uint64_t *reached;         // Clusters alcançados a partir do root (1 bit cada)
+    uint64_t *heads;           // Primeiros clusters dos arquivos
+    uint16_t *chain;           // Cadeia em exame
+    uint32_t data_end;         // Primeiro cluster depois da área de dados (journal)
+    fsck_dir_t *stack;         // Diretórios ainda não examinados
+    uint32_t stack_count;
+    uint32_t stack_capacity;
+    fsck_file_t *files;
+    uint32_t file_count;
+    uint32_t file_capacity;
+} fsck_state_t;
+
+static int fat16_fsck_test(const uint64_t *map, uint16_t cluster) {
+    return (map[cluster / 64] >> (cluster % 64)) & 1;
+}
+
+static void fat16_fsck_set(uint64_t *map, uint16_t cluster) {
+    map[cluster / 64] |= 1ULL << (cluster % 64);
+}
+
+static void fat16_fsck_clear(uint64_t *map, uint16_t cluster) {
+    map[cluster / 64] &= ~(1ULL << (cluster % 64));
+}
+
+// Clusters que podem fazer parte de uma cadeia: o root e a área de dados
+static int fat16_fsck_valid(const fsck_state_t *st, uint16_t cluster) {
+    return cluster == st->fs->root_dir_cluster ||
+           (cluster >= st->fs->data_start_cluster && cluster < st->data_end);
+}
+
+// Confere a entrada da FAT de um cluster reservado
+static void fat16_fsck_expect(fsck_state_t *st, uint16_t cluster, uint16_t expected) {
+    if (st->fs->fat[cluster] != expected) {
+        st->report->reserved_fixes++;
+        if (st->repair) {
+            fat16_set_fat(st->fs, cluster, expected);
+        }
+    }
+}
+
+// Confere as áreas reservadas: boot block, FAT e journal
+static void fat16_fsck_reserved(fsck_state_t *st) {
+    fat16_fs_t *fs = st->fs;
+    
+    fat16_fsck_expect(st, BOOT_BLOCK_CLUSTER, FAT_BOOT_BLOCK);
+    
+    for (uint32_t i = FAT_START_CLUSTER; i < FAT_START_CLUSTER + fs->fat_clusters; i++) {
+        fat16_fsck_expect(st, i, FAT_TABLE);
+    }
+    
+    for (uint32_t i = st->data_end; i < fs->total_clusters; i++) {
+        fat16_fsck_expect(st, i, FAT_TABLE);
+    }
+}
+
+// Percorre uma cadeia marcando seus clusters no mapa de alcançados, em
+// st->chain. Para no primeiro elo inválido (fora da área de dados ou para
+// um cluster livre), laço ou cluster de outra cadeia (já alcançado ou
+// início de outro arquivo) e, com correção, termina a cadeia no último
+// cluster bom. Retorna o número de clusters marcados: 0 se o primeiro
+// cluster já é inválido ou de outra cadeia
+static uint32_t fat16_fsck_chain(fsck_state_t *st, uint16_t first_cluster) {
+    fat16_fs_t *fs = st->fs;
+    uint16_t *chain = st->chain;
+    uint16_t cluster = first_cluster;
+    uint32_t len = 0;
+    
+    while (fat16_fsck_valid(st, cluster) && !fat16_fsck_test(st->reached, cluster) &&
+           (len == 0 || !fat16_fsck_test(st->heads, cluster))) {
+        fat16_fsck_set(st->reached, cluster);
+        chain[len++] = cluster;
+        
+        if (fs->fat[cluster] == FAT_END_OF_FILE) {
+            return len;
+        }
+        cluster = fs->fat[cluster];
+    }
+    
+    if (len == 0) {
+        return 0;
+    }
+    
+    if (!fat16_fsck_valid(st, cluster)) {
+        st->report->bad_links++;
+    } else {
+        // Laço se o cluster já está nesta cadeia; senão, cadeias cruzadas
+        int loop = 0;
+        for (uint32_t i = 0; i < len && !loop; i++) {
+            loop = chain[i] == cluster;
+        }
+        
+        if (loop) {
+            st->report->loops++;
+        } else {
+            st->report->cross_links++;
+        }
+    }
+    
+    if (st->repair) {
+        fat16_set_fat(fs, chain[len - 1], FAT_END_OF_FILE);
+    }
+    return len;
+}
+
+// Remove uma entrada sem cadeia válida. Os clusters que eram só dela
+// ficam fora do mapa e são recuperados como órfãos
+static void fat16_fsck_bad_entry(fsck_state_t *st, uint16_t parent_cluster, const char *name) {
+    st->report->bad_entries++;
+    
+    if (st->repair) {
+        fat16_remove_directory_entry(st->fs, parent_cluster, name);
+    }
+}
+
+// Nome de uma entrada, terminado em '\0'
+static void fat16_fsck_name(const dir_entry_t *entry, char *name) {
+    size_t len = strnlen((const char *)entry->filename, MAX_FILENAME_SIZE);
+    memcpy(name, entry->filename, len);
+    name[len] = '\0';
+    fat16_name_decode((uint8_t *)name);
+}
+
+// Confere a cadeia de um arquivo com o seu tamanho. Uma cadeia mais longa
+// é cortada (os clusters a mais ficam órfãos); uma mais curta define o
+// novo tamanho
+static void fat16_fsck_file(fsck_state_t *st, const fsck_file_t *file) {
+    fat16_fs_t *fs = st->fs;
+    const dir_entry_t *entry = &file->entry;
+    uint16_t parent_cluster = file->parent;
+    char name[MAX_FILENAME_SIZE + 1];
+    
+    fat16_fsck_name(entry, name);
+    
+    // Arquivo vazio, sem cadeia
+    if (entry->first_block == 0) {
+        st->report->files++;
+        if (entry->size > 0) {
+            st->report->size_mismatches++;
+            if (st->repair) {
+                fat16_update_directory_entry(fs, parent_cluster, name, 0, 0);
+            }
+        }
+        return;
+    }
+    
+    uint32_t len = fat16_fsck_chain(st, entry->first_block);
+    if (len == 0) {
+        fat16_fsck_bad_entry(st, parent_cluster, name);
+        return;
+    }
+    
+    st->report->files++;
+    
+    uint32_t expected = entry->size > 0 ? (entry->size + fs->cluster_size - 1) / fs->cluster_size : 1;
+    if (len == expected) {
+        return;
+    }
+    
+    st->report->size_mismatches++;
+    
+    if (len > expected) {
+        for (uint32_t i = expected; i < len; i++) {
+            fat16_fsck_clear(st->reached, st->chain[i]);
+        }
+        if (st->repair) {
+            fat16_set_fat(fs, st->chain[expected - 1], FAT_END_OF_FILE);
+        }
+    } else if (st->repair) {
+        fat16_update_directory_entry(fs, parent_cluster, name, entry->first_block, len * fs->cluster_size);
+    }
+}
+
+// Acrescenta um diretório à pilha de diretórios a examinar
+static int fat16_fsck_push(fsck_state_t *st, uint16_t parent_cluster, uint16_t cluster, const char *name) {
+    if (st->stack_count == st->stack_capacity) {
+        uint32_t capacity = st->stack_capacity ? st->stack_capacity * 2 : 64;
+        fsck_dir_t *stack = realloc(st->stack, sizeof(fsck_dir_t) * capacity);
+        if (!stack) {
+            return -1;
+        }
+        st->stack = stack;
+        st->stack_capacity = capacity;
+    }
+    
+    fsck_dir_t *dir = &st->stack[st->stack_count++];
+    dir->parent = parent_cluster;
+    dir->cluster = cluster;
+    strcpy(dir->name, name);
+    return 0;
+}
+
+// Guarda um arquivo para depois da árvore de diretórios
+static int fat16_fsck_add_file(fsck_state_t *st, uint16_t parent_cluster, const dir_entry_t *entry) {
+    if (st->file_count == st->file_capacity) {
+        uint32_t capacity = st->file_capacity ? st->file_capacity * 2 : 256;
+        fsck_file_t *files = realloc(st->files, sizeof(fsck_file_t) * capacity);
+        if (!files) {
+            return -1;
+        }
+        st->files = files;
+        st->file_capacity = capacity;
+    }
+    
+    st->files[st->file_count].parent = parent_cluster;
+    st->files[st->file_count].entry = *entry;
+    st->file_count++;
+    return 0;
+}
+
+// Examina um diretório: valida sua cadeia, empilha os subdiretórios e
+// guarda os arquivos. As entradas são copiadas, porque as correções
+// alteram o diretório
+static fat16_error_t fat16_fsck_directory(fsck_state_t *st, const fsck_dir_t *dir) {
+    fat16_fs_t *fs = st->fs;
+    
+    uint32_t len = fat16_fsck_chain(st, dir->cluster);
+    if (len == 0) {
+        fat16_fsck_bad_entry(st, dir->parent, dir->name);
+        return FAT16_OK;
+    }
+    
+    st->report->directories++;
+    
+    dir_entry_t *entries = malloc(sizeof(dir_entry_t) * len * fs->dir_entries);
+    void *buffer = fat16_cluster_alloc(fs);
+    uint32_t count = 0;
+    int ended = 0;
+    
+    if (!entries || !buffer) {
+        free(entries);
+        free(buffer);
+        return FAT16_ERR_NO_MEMORY;
+    }
+    
+    for (uint32_t i = 0; i < len && !ended; i++) {
+        const dir_entry_t *cluster = fat16_get_cluster(fs, st->chain[i], buffer);
+        if (!cluster) {
+            free(entries);
+            free(buffer);
+            return FAT16_ERR_IO;
+        }
+        
+        for (uint32_t k = 0; k < fs->dir_entries; k++) {
+            if (cluster[k].filename[0] == DIR_ENTRY_END) {
+                ended = 1;
+                break;
+            }
+            if (cluster[k].filename[0] != DIR_ENTRY_DELETED) {
+                entries[count++] = cluster[k];
+            }
+        }
+    }
+    
+    free(buffer);
+    
+    fat16_error_t err = FAT16_OK;
+    
+    for (uint32_t i = 0; i < count && err == FAT16_OK; i++) {
+        int result;
+        
+        if (entries[i].attributes == ATTR_DIRECTORY) {
+            char name[MAX_FILENAME_SIZE + 1];
+            fat16_fsck_name(&entries[i], name);
+            result = fat16_fsck_push(st, dir->cluster, entries[i].first_block, name);
+        } else {
+            result = fat16_fsck_add_file(st, dir->cluster, &entries[i]);
+        }
+        
+        if (result != 0) {
+            err = FAT16_ERR_NO_MEMORY;
+        }
+    }
+    
+    free(entries);
+    return err;
+}
+
+// Verifica a FAT e a árvore de diretórios numa passagem linear: percorre
+// os diretórios a partir do root e depois os arquivos encontrados,
+// marcando num mapa de bits os clusters de cada cadeia, o que detecta elos
+// inválidos, laços e clusters em duas cadeias sem seguir nenhum elo duas
+// vezes; no fim, os clusters ocupados fora do mapa são órfãos. Com
+// 'repair', cadeias são cortadas no último cluster bom (diretórios e o
+// arquivo que começa num cluster têm preferência sobre quem o alcança
+// pelo meio), tamanhos são ajustados, entradas sem cadeia são removidas e
+// órfãos são liberados.
+// As operações esperam o fim da verificação. Sem 'repair', retorna
+// FAT16_ERR_CORRUPT se encontrou problemas
+fat16_error_t fat16_fsck(fat16_fs_t *fs, int repair, fat16_fsck_report_t *report) {
+    fat16_fsck_report_t local;
+    fsck_state_t st;
+    
+    if (!report) {
+        report = &local;
+    }
+    memset(report, 0, sizeof(fat16_fsck_report_t));
+    
+    if (!fs->partition_file) {
+        return FAT16_ERR_INVALID;
+    }
+    
+    uint64_t start = fat16_stats_clock();
+    size_t words = (fs->total_clusters + 63) / 64;
+    
+    memset(&st, 0, sizeof(st));
+    st.fs = fs;
+    st.repair = repair;
+    st.report = report;
+    st.data_end = fs->journal.start ? fs->journal.start : fs->total_clusters;
+    st.reached = calloc(words, sizeof(uint64_t));
+    st.heads = calloc(words, sizeof(uint64_t));
+    st.chain = malloc(sizeof(uint16_t) * fs->total_clusters);
+    
+    fat16_error_t err = FAT16_OK;
+    if (!st.reached || !st.heads || !st.chain ||
+        fat16_fsck_push(&st, 0, fs->root_dir_cluster, "/") != 0) {
+        err = FAT16_ERR_NO_MEMORY;
+    }
+    
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    
+    // Índices e cache de entradas são refeitos a partir das cadeias conferidas
+    fat16_dir_index_clear(fs);
+    fat16_dcache_clear(fs);
+    
+    if (err == FAT16_OK) {
+        fat16_fsck_reserved(&st);
+    }
+    
+    while (err == FAT16_OK && st.stack_count > 0) {
+        fsck_dir_t dir = st.stack[--st.stack_count];
+        err = fat16_fsck_directory(&st, &dir);
+    }
+    
+    // Um arquivo cujo primeiro cluster é alcançado pelo meio de outra
+    // cadeia fica com ele: a outra é que está cruzada
+    for (uint32_t i = 0; err == FAT16_OK && i < st.file_count; i++) {
+        uint16_t head = st.files[i].entry.first_block;
+        if (fat16_fsck_valid(&st, head)) {
+            fat16_fsck_set(st.heads, head);
+        }
+    }
+    
+    for (uint32_t i = 0; err == FAT16_OK && i < st.file_count; i++) {
+        fat16_fsck_file(&st, &st.files[i]);
+    }
+    
+    // Clusters ocupados que nenhuma cadeia alcançou
+    for (uint32_t i = fs->data_start_cluster; err == FAT16_OK && i < st.data_end; i++) {
+        if (fs->fat[i] != FAT_FREE && !fat16_fsck_test(st.reached, i)) {
+            report->orphan_clusters++;
+            if (repair) {
+                fat16_set_fat(fs, i, FAT_FREE);
+            }
+        }
+    }
+    
+    if (err == FAT16_OK && repair && fat16_write_fat(fs) != 0) {
+        err = FAT16_ERR_IO;
+    }
+    
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    for (size_t i = 0; st.reached && i < words; i++) {
+        report->used_clusters += __builtin_popcountll(st.reached[i]);
+    }
+    
+    free(st.reached);
+    free(st.heads);
+    free(st.chain);
+    free(st.stack);
+    free(st.files);
+    
+    report->elapsed_ns = fat16_stats_clock() - start;
+    
+    uint32_t problems = report->bad_links + report->loops + report->cross_links + report->size_mismatches +
+                        report->bad_entries + report->orphan_clusters + report->reserved_fixes;
+    if (err == FAT16_OK && !repair && problems > 0) {
+        err = FAT16_ERR_CORRUPT;
+    }
+    return err;
+}
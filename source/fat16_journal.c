@@ -0,0 +1,616 @@
+#include "../include/fat16.h"
+
+// Journal de metadados. As operações não gravam a FAT e os diretórios no
+// lugar: a versão nova de cada cluster fica em memória (entries) e é
+// servida às leituras. A cada JOURNAL_COMMIT_MS, ou no fat16_sync, as
+// alterações acumuladas por todas as operações do período vão para o
+// journal como uma transação (uma escrita seqüencial e um fdatasync) e
+// depois para o lugar. Ao carregar a partição, as transações completas
+// são reaplicadas, então os metadados nunca ficam pela metade. O conteúdo
+// dos arquivos não passa pelo journal.
+
+// Checksum FNV-1a, continuando de 'hash'
+static uint32_t fat16_journal_hash(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+// Quantas imagens cabem em uma transação
+static uint32_t fat16_journal_max_count(fat16_fs_t *fs) {
+    uint32_t per_descriptor = (fs->cluster_size - sizeof(journal_descriptor_t)) / sizeof(uint16_t);
+    uint32_t per_journal = fs->journal.clusters - 2;
+    
+    return per_descriptor < per_journal ? per_descriptor : per_journal;
+}
+
+// Checksum de uma transação (descritor seguido das imagens)
+static uint32_t fat16_journal_checksum(fat16_fs_t *fs, uint8_t *txn, uint32_t count) {
+    journal_descriptor_t *desc = (journal_descriptor_t *)txn;
+    uint32_t saved = desc->checksum;
+    
+    desc->checksum = 0;
+    uint32_t hash = fat16_journal_hash(2166136261u, txn, (size_t)(count + 1) * fs->cluster_size);
+    desc->checksum = saved;
+    return hash;
+}
+
+// Escreve clusters do journal diretamente na partição (nunca pelo cache)
+static int fat16_journal_pwrite(fat16_fs_t *fs, uint32_t pos, const void *data, uint32_t count) {
+    size_t len = (size_t)count * fs->cluster_size;
+    off_t offset = (off_t)(fs->journal.start + pos) * fs->cluster_size;
+    
+    fat16_stats_add(&fs->stats.disk_writes, 1);
+    fat16_stats_add(&fs->stats.bytes_written, len);
+    
+    return pwrite(fileno(fs->partition_file), data, len, offset) == (ssize_t)len ? 0 : -1;
+}
+
+// fdatasync da partição
+static int fat16_journal_flush(fat16_fs_t *fs) {
+    fat16_stats_add(&fs->stats.flushes, 1);
+    return fdatasync(fileno(fs->partition_file));
+}
+
+// Grava o cabeçalho com a próxima seqüência: o journal fica vazio
+static int fat16_journal_write_header(fat16_fs_t *fs) {
+    uint8_t *buffer = fat16_cluster_alloc(fs);
+    if (!buffer) {
+        return -1;
+    }
+    
+    journal_header_t *header = (journal_header_t *)buffer;
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+    header->sequence = fs->journal.sequence;
+    
+    int result = fat16_journal_pwrite(fs, 0, buffer, 1);
+    free(buffer);
+    return result;
+}
+
+// Tamanho do journal para a geometria atual: JOURNAL_BYTES, com no máximo
+// um quarto da área de dados (0 se a partição é pequena demais)
+uint32_t fat16_journal_default_clusters(fat16_fs_t *fs) {
+    uint32_t clusters = JOURNAL_BYTES / fs->cluster_size;
+    uint32_t limit = (fs->total_clusters - fs->data_start_cluster) / 4;
+    
+    if (clusters < JOURNAL_MIN_CLUSTERS) {
+        clusters = JOURNAL_MIN_CLUSTERS;
+    }
+    
+    if (clusters > limit) {
+        clusters = limit;
+    }
+    
+    return clusters >= JOURNAL_MIN_CLUSTERS ? clusters : 0;
+}
+
+// Reserva os 'clusters' finais da partição para o journal (0 = sem journal)
+int fat16_journal_layout(fat16_fs_t *fs, uint32_t clusters) {
+    fat16_journal_t *j = &fs->journal;
+    
+    j->start = 0;
+    j->clusters = 0;
+    
+    if (clusters == 0) {
+        return 0;
+    }
+    
+    // Sobra ao menos um cluster de dados
+    if (clusters < JOURNAL_MIN_CLUSTERS || clusters >= fs->total_clusters - fs->data_start_cluster) {
+        return -1;
+    }
+    
+    j->start = fs->total_clusters - clusters;
+    j->clusters = clusters;
+    return 0;
+}
+
+// Grava um journal vazio (na formatação)
+int fat16_journal_format(fat16_fs_t *fs) {
+    if (!fs->journal.start) {
+        return 0;
+    }
+    
+    fs->journal.sequence = 1;
+    fs->journal.head = 1;
+    return fat16_journal_write_header(fs);
+}
+
+// Reaplica as transações completas (em fat16_load, antes de ler a FAT).
+// Cada uma precisa ter a seqüência esperada, destinos válidos e checksum
+// correto; a primeira que não tem marca o fim do que chegou ao disco.
+// Retorna quantas transações foram reaplicadas, ou -1
+int fat16_journal_replay(fat16_fs_t *fs) {
+    fat16_journal_t *j = &fs->journal;
+    size_t cs = fs->cluster_size;
+    int fd = fileno(fs->partition_file);
+    int replayed = 0;
+    
+    if (!j->start) {
+        return 0;
+    }
+    
+    uint8_t *buffer = malloc((size_t)j->clusters * cs);
+    if (!buffer) {
+        return -1;
+    }
+    
+    if (pread(fd, buffer, (size_t)j->clusters * cs, (off_t)j->start * cs) != (ssize_t)(j->clusters * cs)) {
+        free(buffer);
+        return -1;
+    }
+    
+    // Sem cabeçalho válido não há o que reaplicar
+    journal_header_t *header = (journal_header_t *)buffer;
+    uint32_t sequence = 1;
+    if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) == 0) {
+        sequence = header->sequence;
+    }
+    
+    uint32_t pos = 1;
+    uint32_t max_count = fat16_journal_max_count(fs);
+    
+    while (memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) == 0 && pos + 1 < j->clusters) {
+        uint8_t *txn = buffer + (size_t)pos * cs;
+        journal_descriptor_t *desc = (journal_descriptor_t *)txn;
+        
+        if (memcmp(desc->magic, JOURNAL_TXN_MAGIC, sizeof(desc->magic)) != 0 ||
+            desc->sequence != sequence || desc->count == 0 || desc->count > max_count ||
+            pos + 1 + desc->count > j->clusters ||
+            fat16_journal_checksum(fs, txn, desc->count) != desc->checksum) {
+            break;
+        }
+        
+        // Só a FAT e os clusters antes do journal recebem imagens
+        uint32_t i;
+        for (i = 0; i < desc->count; i++) {
+            if (desc->clusters[i] < FAT_START_CLUSTER || desc->clusters[i] >= j->start) {
+                break;
+            }
+        }
+        
+        if (i < desc->count) {
+            break;
+        }
+        
+        for (i = 0; i < desc->count; i++) {
+            if (pwrite(fd, txn + (i + 1) * cs, cs, (off_t)desc->clusters[i] * cs) != (ssize_t)cs) {
+                free(buffer);
+                return -1;
+            }
+        }
+        
+        pos += 1 + desc->count;
+        sequence++;
+        replayed++;
+    }
+    
+    free(buffer);
+    
+    // As imagens precisam estar no lugar antes de o journal ser esvaziado
+    if (replayed > 0 && fdatasync(fd) != 0) {
+        return -1;
+    }
+    
+    j->sequence = sequence;
+    j->head = 1;
+    
+    if (fat16_journal_write_header(fs) != 0) {
+        return -1;
+    }
+    
+    return replayed;
+}
+
+// Thread de commits em grupo: acorda a cada JOURNAL_COMMIT_MS, ou antes
+// quando as alterações pendentes ocupam metade do journal
+static void *fat16_journal_thread(void *arg) {
+    fat16_fs_t *fs = arg;
+    fat16_journal_t *j = &fs->journal;
+    
+    pthread_mutex_lock(&j->lock);
+    
+    while (!j->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)JOURNAL_COMMIT_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        
+        pthread_cond_timedwait(&j->wakeup, &j->lock, &deadline);
+        
+        if (j->stop || (j->count == 0 && j->deferred_count == 0)) {
+            continue;
+        }
+        
+        pthread_mutex_unlock(&j->lock);
+        fat16_journal_commit(fs);
+        pthread_mutex_lock(&j->lock);
+    }
+    
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
+
+// Ativa o journal da partição aberta e inicia a thread de commits
+int fat16_journal_start(fat16_fs_t *fs) {
+    fat16_journal_t *j = &fs->journal;
+    
+    if (!j->start) {
+        return 0;
+    }
+    
+    j->slot_of = malloc(sizeof(int32_t) * fs->total_clusters);
+    if (!j->slot_of) {
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < fs->total_clusters; i++) {
+        j->slot_of[i] = -1;
+    }
+    
+    j->running = 1;
+    j->committed = 0;
+    j->stop = 0;
+    j->active = 1;
+    
+    if (pthread_create(&j->thread, NULL, fat16_journal_thread, fs) != 0) {
+        fat16_journal_destroy(fs);
+        return -1;
+    }
+    
+    j->thread_running = 1;
+    return 0;
+}
+
+// Para a thread de commits (em fat16_close, antes do último fat16_sync)
+void fat16_journal_stop(fat16_fs_t *fs) {
+    fat16_journal_t *j = &fs->journal;
+    
+    if (!j->thread_running) {
+        return;
+    }
+    
+    pthread_mutex_lock(&j->lock);
+    j->stop = 1;
+    pthread_cond_signal(&j->wakeup);
+    pthread_mutex_unlock(&j->lock);
+    
+    pthread_join(j->thread, NULL);
+    j->thread_running = 0;
+}
+
+// Descarta o estado em memória do journal (a thread já parou)
+void fat16_journal_destroy(fat16_fs_t *fs) {
+    fat16_journal_t *j = &fs->journal;
+    
+    for (uint32_t i = 0; i < j->count; i++) {
+        free(j->entries[i].data);
+    }
+    
+    free(j->entries);
+    free(j->slot_of);
+    free(j->deferred);
+    free(j->deferred_group);
+    j->entries = NULL;
+    j->slot_of = NULL;
+    j->deferred = NULL;
+    j->deferred_group = NULL;
+    j->count = 0;
+    j->capacity = 0;
+    j->deferred_count = 0;
+    j->deferred_capacity = 0;
+    j->active = 0;
+}
+
+// Copia a versão pendente do cluster, se houver (0 = copiada)
+int fat16_journal_read(fat16_fs_t *fs, uint16_t cluster_num, void *buffer) {
+    fat16_journal_t *j = &fs->journal;
+    int result = -1;
+    
+    if (!j->active || cluster_num >= fs->total_clusters) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&j->lock);
+    
+    int32_t slot = j->slot_of[cluster_num];
+    if (slot >= 0) {
+        memcpy(buffer, j->entries[slot].data, fs->cluster_size);
+        result = 0;
+    }
+    
+    pthread_mutex_unlock(&j->lock);
+    return result;
+}
+
+// Registra a nova versão de um cluster de metadados; vai para a partição
+// no próximo commit
+int fat16_journal_write(fat16_fs_t *fs, uint16_t cluster_num, const void *buffer) {
+    fat16_journal_t *j = &fs->journal;
+    
+    pthread_mutex_lock(&j->lock);
+    
+    int32_t slot = j->slot_of[cluster_num];
+    if (slot < 0) {
+        if (j->count == j->capacity) {
+            uint32_t capacity = j->capacity ? j->capacity * 2 : 64;
+            journal_entry_t *entries = realloc(j->entries, sizeof(journal_entry_t) * capacity);
+            if (!entries) {
+                pthread_mutex_unlock(&j->lock);
+                return -1;
+            }
+            j->entries = entries;
+            j->capacity = capacity;
+        }
+        
+        uint8_t *data = malloc(fs->cluster_size);
+        if (!data) {
+            pthread_mutex_unlock(&j->lock);
+            return -1;
+        }
+        
+        slot = j->count++;
+        j->entries[slot].cluster = cluster_num;
+        j->entries[slot].version = 0;
+        j->entries[slot].data = data;
+        j->slot_of[cluster_num] = slot;
+    }
+    
+    memcpy(j->entries[slot].data, buffer, fs->cluster_size);
+    j->entries[slot].version++;
+    
+    int pressure = j->count * 2 >= j->clusters;
+    
+    pthread_mutex_unlock(&j->lock);
+    
+    if (pressure) {
+        pthread_cond_signal(&j->wakeup);
+    }
+    
+    // A cópia do cache ficou antiga e não pode mais ir para a partição
+    if (fs->cache.data) {
+        fat16_cache_discard(fs, cluster_num);
+    }
+    
+    return 0;
+}
+
+// Adia a volta ao índice de livres de um cluster de diretório que acabou
+// de ser marcado livre na FAT. Até o checkpoint seguinte ao commit que
+// registra a liberação, o journal pode guardar imagens antigas dele, que
+// uma reaplicação gravaria por cima dos dados de um novo dono. Vale também
+// para a cadeia antiga de um arquivo realocado: até lá, uma queda volta à
+// entrada que aponta para ela. Chamado com a fat_lock
+void fat16_journal_defer_free(fat16_fs_t *fs, uint16_t cluster_num) {
+    fat16_journal_t *j = &fs->journal;
+    
+    pthread_mutex_lock(&j->lock);
+    
+    if (j->deferred_count == j->deferred_capacity) {
+        uint32_t capacity = j->deferred_capacity ? j->deferred_capacity * 2 : 16;
+        uint16_t *deferred = realloc(j->deferred, sizeof(uint16_t) * capacity);
+        if (deferred) {
+            j->deferred = deferred;
+        }
+        uint32_t *groups = realloc(j->deferred_group, sizeof(uint32_t) * capacity);
+        if (groups) {
+            j->deferred_group = groups;
+        }
+        
+        // Sem memória o cluster volta a ser livre na hora
+        if (!deferred || !groups) {
+            pthread_mutex_unlock(&j->lock);
+            return;
+        }
+        j->deferred_capacity = capacity;
+    }
+    
+    j->deferred[j->deferred_count] = cluster_num;
+    j->deferred_group[j->deferred_count] = j->running;
+    j->deferred_count++;
+    
+    pthread_mutex_unlock(&j->lock);
+    
+    fat16_free_map_update(fs, cluster_num, 0);
+}
+
+// Remove uma entrada já gravada no lugar (com a trava do journal)
+static void fat16_journal_remove(fat16_journal_t *j, int32_t slot) {
+    free(j->entries[slot].data);
+    j->slot_of[j->entries[slot].cluster] = -1;
+    
+    j->count--;
+    if ((uint32_t)slot != j->count) {
+        j->entries[slot] = j->entries[j->count];
+        j->slot_of[j->entries[slot].cluster] = slot;
+    }
+}
+
+// Torna duráveis os clusters já gravados no lugar e esvazia o journal;
+// então libera os clusters de diretório de grupos já registrados
+static int fat16_journal_checkpoint_locked(fat16_fs_t *fs) {
+    fat16_journal_t *j = &fs->journal;
+    
+    if (fat16_journal_flush(fs) != 0) {
+        return -1;
+    }
+    
+    j->head = 1;
+    if (fat16_journal_write_header(fs) != 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&j->lock);
+    
+    uint16_t *released = malloc(sizeof(uint16_t) * (j->deferred_count + 1));
+    uint32_t count = 0;
+    uint32_t kept = 0;
+    
+    for (uint32_t i = 0; released && i < j->deferred_count; i++) {
+        if (j->deferred_group[i] <= j->committed) {
+            released[count++] = j->deferred[i];
+        } else {
+            j->deferred[kept] = j->deferred[i];
+            j->deferred_group[kept] = j->deferred_group[i];
+            kept++;
+        }
+    }
+    
+    if (released) {
+        j->deferred_count = kept;
+    }
+    fat16_stats_add(&fs->stats.journal_checkpoints, 1);
+    
+    pthread_mutex_unlock(&j->lock);
+    
+    // Só volta ao índice o que continua livre na FAT
+    fat16_fat_lock(fs);
+    for (uint32_t i = 0; i < count; i++) {
+        if (fs->fat[released[i]] == FAT_FREE) {
+            fat16_free_map_update(fs, released[i], 1);
+        }
+    }
+    fat16_fat_unlock(fs);
+    
+    free(released);
+    return 0;
+}
+
+// Esvazia o journal depois de tornar duráveis os clusters no lugar
+int fat16_journal_checkpoint(fat16_fs_t *fs) {
+    if (!fs->journal.active) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&fs->journal.commit_lock);
+    int result = fat16_journal_checkpoint_locked(fs);
+    pthread_mutex_unlock(&fs->journal.commit_lock);
+    return result;
+}
+
+// Grava as alterações pendentes como uma transação. Com o espaço de nomes
+// travado para escrita (nenhuma operação pela metade), copia as imagens
+// para um buffer; depois, já sem a trava, grava descritor e imagens com
+// uma escrita, faz um fdatasync e grava os clusters no lugar. Alterações
+// feitas durante a gravação ficam para o próximo commit. Um grupo maior
+// que o journal é gravado direto no lugar, sem atomicidade
+int fat16_journal_commit(fat16_fs_t *fs) {
+    fat16_journal_t *j = &fs->journal;
+    size_t cs = fs->cluster_size;
+    int result = 0;
+    
+    if (!j->active) {
+        return 0;
+    }
+    
+    uint64_t start = fat16_stats_clock();
+    
+    pthread_mutex_lock(&j->commit_lock);
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    
+    // A FAT em memória vai junto com os diretórios que a referenciam
+    if (fat16_write_fat(fs) != 0) {
+        result = -1;
+    }
+    
+    pthread_mutex_lock(&j->lock);
+    
+    uint32_t count = j->count;
+    uint32_t group = j->running++;
+    uint8_t *txn = NULL;
+    uint16_t *targets = NULL;
+    uint32_t *versions = NULL;
+    
+    if (count > 0) {
+        txn = calloc(count + 1, cs);
+        targets = malloc(sizeof(uint16_t) * count);
+        versions = malloc(sizeof(uint32_t) * count);
+        if (!txn || !targets || !versions) {
+            result = -1;
+        }
+    }
+    
+    for (uint32_t i = 0; result == 0 && i < count; i++) {
+        targets[i] = j->entries[i].cluster;
+        versions[i] = j->entries[i].version;
+        memcpy(txn + (size_t)(i + 1) * cs, j->entries[i].data, cs);
+    }
+    
+    pthread_mutex_unlock(&j->lock);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    int fits = count <= fat16_journal_max_count(fs);
+    
+    // Journal cheio (ou grupo grande demais): esvazia antes
+    if (result == 0 && count > 0 && (!fits || j->head + 1 + count > j->clusters)) {
+        result = fat16_journal_checkpoint_locked(fs);
+    }
+    
+    if (result == 0 && count > 0 && fits) {
+        journal_descriptor_t *desc = (journal_descriptor_t *)txn;
+        memcpy(desc->magic, JOURNAL_TXN_MAGIC, sizeof(desc->magic));
+        desc->sequence = j->sequence;
+        desc->count = count;
+        memcpy(desc->clusters, targets, sizeof(uint16_t) * count);
+        desc->checksum = fat16_journal_checksum(fs, txn, count);
+        
+        if (fat16_journal_pwrite(fs, j->head, txn, count + 1) != 0 ||
+            fat16_journal_flush(fs) != 0) {
+            result = -1;
+        } else {
+            j->head += count + 1;
+            j->sequence++;
+        }
+    }
+    
+    // Registrada a transação, os clusters vão para o lugar
+    for (uint32_t i = 0; result == 0 && i < count; i++) {
+        result = fat16_disk_write_cluster(fs, targets[i], txn + (size_t)(i + 1) * cs);
+    }
+    
+    if (result == 0 && count > 0 && !fits && fat16_journal_flush(fs) != 0) {
+        result = -1;
+    }
+    
+    pthread_mutex_lock(&j->lock);
+    
+    if (result == 0) {
+        // Entradas alteradas durante a gravação continuam pendentes
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t slot = j->slot_of[targets[i]];
+            if (slot >= 0 && j->entries[slot].version == versions[i]) {
+                fat16_journal_remove(j, slot);
+            }
+        }
+        j->committed = group;
+        fat16_stats_add(&fs->stats.journal_commits, count > 0);
+        fat16_stats_add(&fs->stats.journal_clusters, count);
+    }
+    
+    int release = result == 0 && j->deferred_count > 0;
+    
+    pthread_mutex_unlock(&j->lock);
+    
+    free(txn);
+    free(versions);
+    free(targets);
+    
+    if (release) {
+        result = fat16_journal_checkpoint_locked(fs);
+    }
+    
+    pthread_mutex_unlock(&j->commit_lock);
+    
+    // Commits vazios (timer sem alterações) não entram no histograma
+    if (count > 0) {
+        fat16_stats_record(fs, FAT16_OP_COMMIT, start);
+    }
+    return result;
+}
@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include "../include/fat16.h"
+
+// Cria as travas do sistema de arquivos (em fat16_init/fat16_load)
+int fat16_locks_init(fat16_fs_t *fs) {
+    pthread_mutexattr_t attr;
+    
+    if (fs->locks_ready) {
+        return 0;
+    }
+    
+    // A FAT é alterada por funções que chamam umas às outras
+    // (fat16_resize_chain -> fat16_alloc_chain -> fat16_set_fat)
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    int result = pthread_mutex_init(&fs->fat_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    
+    if (result != 0) {
+        return -1;
+    }
+    
+    // Escritores na frente: o commit do journal não espera o fim de um
+    // fluxo contínuo de operações
+    pthread_rwlockattr_t rwattr;
+    pthread_rwlockattr_init(&rwattr);
+    pthread_rwlockattr_setkind_np(&rwattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&fs->ns_lock, &rwattr);
+    pthread_rwlockattr_destroy(&rwattr);
+    
+    for (size_t i = 0; i < DIR_LOCK_STRIPES; i++) {
+        pthread_rwlock_init(&fs->dir_locks[i], NULL);
+    }
+    pthread_mutex_init(&fs->dir_index_lock, NULL);
+    pthread_mutex_init(&fs->cache.lock, NULL);
+    pthread_mutex_init(&fs->dcache.lock, NULL);
+    pthread_mutex_init(&fs->journal.lock, NULL);
+    pthread_mutex_init(&fs->journal.commit_lock, NULL);
+    pthread_cond_init(&fs->journal.wakeup, NULL);
+    
+    fs->locks_ready = 1;
+    return 0;
+}
+
+// Destrói as travas (em fat16_close, sem outras threads usando a partição)
+void fat16_locks_destroy(fat16_fs_t *fs) {
+    if (!fs->locks_ready) {
+        return;
+    }
+    
+    pthread_rwlock_destroy(&fs->ns_lock);
+    for (size_t i = 0; i < DIR_LOCK_STRIPES; i++) {
+        pthread_rwlock_destroy(&fs->dir_locks[i]);
+    }
+    pthread_mutex_destroy(&fs->fat_lock);
+    pthread_mutex_destroy(&fs->dir_index_lock);
+    pthread_mutex_destroy(&fs->cache.lock);
+    pthread_mutex_destroy(&fs->dcache.lock);
+    pthread_mutex_destroy(&fs->journal.lock);
+    pthread_mutex_destroy(&fs->journal.commit_lock);
+    pthread_cond_destroy(&fs->journal.wakeup);
+    
+    fs->locks_ready = 0;
+}
+
+// Trava do grupo ao qual o diretório pertence
+static pthread_rwlock_t *fat16_dir_lock(fat16_fs_t *fs, uint16_t dir_cluster) {
+    return &fs->dir_locks[dir_cluster % DIR_LOCK_STRIPES];
+}
+
+// Trava um diretório para consulta
+void fat16_dir_rdlock(fat16_fs_t *fs, uint16_t dir_cluster) {
+    pthread_rwlock_rdlock(fat16_dir_lock(fs, dir_cluster));
+}
+
+// Trava um diretório para alteração
+void fat16_dir_wrlock(fat16_fs_t *fs, uint16_t dir_cluster) {
+    pthread_rwlock_wrlock(fat16_dir_lock(fs, dir_cluster));
+}
+
+// Libera a trava de um diretório
+void fat16_dir_unlock(fat16_fs_t *fs, uint16_t dir_cluster) {
+    pthread_rwlock_unlock(fat16_dir_lock(fs, dir_cluster));
+}
+
+// Tenta travar um diretório para alteração sem esperar (0 se conseguiu).
+// Falha também quando a própria thread já usa o grupo
+int fat16_dir_trywrlock(fat16_fs_t *fs, uint16_t dir_cluster) {
+    return pthread_rwlock_trywrlock(fat16_dir_lock(fs, dir_cluster)) == 0 ? 0 : -1;
+}
+
+// Trava a FAT e o índice de clusters livres
+void fat16_fat_lock(fat16_fs_t *fs) {
+    pthread_mutex_lock(&fs->fat_lock);
+}
+
+// Libera a FAT
+void fat16_fat_unlock(fat16_fs_t *fs) {
+    pthread_mutex_unlock(&fs->fat_lock);
+}
+
+// Geração atual da FAT, lida sem trava por handles de arquivo
+uint32_t fat16_chain_generation(fat16_fs_t *fs) {
+    return __atomic_load_n(&fs->chain_generation, __ATOMIC_ACQUIRE);
+}
@@ -1,438 +1,794 @@
 #include "../include/fat16.h"
 
-// Lista o conteúdo de um diretório
-int fat16_ls(fat16_fs_t *fs, const char *path) {
-    uint16_t cluster;
+// Mensagem correspondente a um código de erro
+const char *fat16_strerror(fat16_error_t err) {
+    switch (err) {
+    case FAT16_OK:                       return "Sucesso";
+    case FAT16_ERR_IO:                   return "Erro de leitura/escrita na partição";
+    case FAT16_ERR_NOT_FOUND:            return "Arquivo ou diretório não encontrado";
+    case FAT16_ERR_PARENT_NOT_FOUND:     return "Diretório pai não encontrado";
+    case FAT16_ERR_NOT_DIRECTORY:        return "Não é um diretório";
+    case FAT16_ERR_PARENT_NOT_DIRECTORY: return "Diretório pai não é um diretório";
+    case FAT16_ERR_NOT_FILE:             return "Não é um arquivo";
+    case FAT16_ERR_EXISTS:               return "Arquivo ou diretório já existe";
+    case FAT16_ERR_NOT_EMPTY:            return "Diretório não está vazio";
+    case FAT16_ERR_NO_SPACE:             return "Não há clusters livres suficientes";
+    case FAT16_ERR_NO_MEMORY:            return "Memória insuficiente";
+    case FAT16_ERR_GEOMETRY:             return "Geometria inválida";
+    case FAT16_ERR_CORRUPT:              return "Partição inválida ou corrompida";
+    case FAT16_ERR_HOST:                 return "Erro ao acessar arquivo do sistema hospedeiro";
+    case FAT16_ERR_INVALID:              return "Argumento inválido";
+    }
+    return "Erro desconhecido";
+}
+
+// Corpo de fat16_stat, sem entrar nas estatísticas da operação
+static fat16_error_t fat16_stat_entry(fat16_fs_t *fs, const char *path, dir_entry_t *entry) {
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    int found = fat16_find_directory_entry(fs, path, entry, NULL);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    return found == 0 ? FAT16_OK : FAT16_ERR_NOT_FOUND;
+}
+
+// Consulta a entrada de um caminho
+fat16_error_t fat16_stat(fat16_fs_t *fs, const char *path, dir_entry_t *entry) {
+    uint64_t start = fat16_stats_clock();
+    fat16_error_t err = fat16_stat_entry(fs, path, entry);
+    fat16_stats_record(fs, FAT16_OP_STAT, start);
+    return err;
+}
+
+// Abre um diretório para iteração com fat16_readdir
+fat16_error_t fat16_opendir(fat16_fs_t *fs, const char *path, fat16_dir_t *dir) {
     dir_entry_t entry;
     
     if (path == NULL || strlen(path) == 0) {
-        cluster = ROOT_DIR_CLUSTER;
+        dir->cluster = fs->root_dir_cluster;
     } else {
-        if (fat16_find_directory_entry(fs, path, &entry, NULL) != 0) {
-            printf("Diretório não encontrado: %s\n", path);
-            return -1;
+        fat16_error_t err = fat16_stat_entry(fs, path, &entry);
+        if (err != FAT16_OK) {
+            return err;
         }
         
         if (entry.attributes != ATTR_DIRECTORY) {
-            printf("'%s' não é um diretório\n", path);
-            return -1;
+            return FAT16_ERR_NOT_DIRECTORY;
         }
         
-        cluster = entry.first_block;
+        dir->cluster = entry.first_block;
     }
     
-    data_cluster_t cluster_data;
-    if (fat16_read_cluster(fs, cluster, &cluster_data) != 0) {
-        printf("Erro ao ler diretório\n");
-        return -1;
-    }
-    
-    printf("Conteúdo do diretório %s:\n", path ? path : "/");
-    printf("%-18s %-10s %-8s %s\n\n", "Nome", "Tipo", "Tamanho", "Cluster");
+    dir->pos = 0;
+    return FAT16_OK;
+}
 
+// Copia a próxima entrada do diretório para 'entry'. Retorna 1 quando há
+// entrada, 0 no fim do diretório ou um código de erro negativo. Entradas
+// criadas ou removidas durante a iteração podem ou não aparecer
+int fat16_readdir(fat16_fs_t *fs, fat16_dir_t *dir, dir_entry_t *entry) {
+    uint64_t start = fat16_stats_clock();
+    int result = 0;
+    
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    fat16_dir_rdlock(fs, dir->cluster);
     
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (cluster_data.dir[i].filename[0] == 0) {
+    dir_index_t *idx = fat16_dir_index_get(fs, dir->cluster);
+    if (!idx) {
+        result = FAT16_ERR_IO;
+    }
+    
+    while (idx && dir->pos < idx->count) {
+        const dir_entry_t *current = &idx->entries[dir->pos++];
+        
+        if (current->filename[0] != DIR_ENTRY_DELETED) {
+            *entry = *current;
+            fat16_name_decode(entry->filename);
+            result = 1;
             break;
         }
-        
-        printf("%-18s %-10s %-8u %u\n",
-               cluster_data.dir[i].filename,
-               cluster_data.dir[i].attributes == ATTR_DIRECTORY ? "DIR" : "FILE",
-               cluster_data.dir[i].size,
-               cluster_data.dir[i].first_block);
     }
     
-    return 0;
+    fat16_dir_index_put(idx);
+    fat16_dir_unlock(fs, dir->cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    
+    fat16_stats_record(fs, FAT16_OP_READDIR, start);
+    return result;
 }
 
-// Cria um diretório
-int fat16_mkdir(fat16_fs_t *fs, const char *path) {
-    char parent_path[256];
-    char dirname[MAX_FILENAME_SIZE + 1];
-    
-    fat16_parse_path(path, parent_path, dirname);
-    
-    // Verifica se o diretório pai existe
+// Encontra o cluster do diretório pai de um caminho
+static fat16_error_t fat16_resolve_parent(fat16_fs_t *fs, const char *parent_path, uint16_t *parent_cluster) {
     dir_entry_t parent_entry;
-    uint16_t parent_cluster;
     
     if (strcmp(parent_path, "/") == 0) {
-        parent_cluster = ROOT_DIR_CLUSTER;
-    } else {
-        if (fat16_find_directory_entry(fs, parent_path, &parent_entry, &parent_cluster) != 0) {
-            printf("Diretório pai não encontrado: %s\n", parent_path);
-            return -1;
-        }
-        parent_cluster = parent_entry.first_block;
+        *parent_cluster = fs->root_dir_cluster;
+        return FAT16_OK;
     }
     
-    // Verifica se o diretório já existe
-    dir_entry_t existing_entry;
-    if (fat16_find_directory_entry(fs, path, &existing_entry, NULL) == 0) {
-        printf("Diretório já existe: %s\n", path);
-        return -1;
+    if (fat16_find_directory_entry(fs, parent_path, &parent_entry, NULL) != 0) {
+        return FAT16_ERR_PARENT_NOT_FOUND;
     }
-    
-    // Encontra um cluster livre
-    uint16_t free_cluster = fat16_find_free_cluster(fs);
-    if (free_cluster == 0) {
-        printf("Erro: Não há clusters livres\n");
-        return -1;
+    if (parent_entry.attributes != ATTR_DIRECTORY) {
+        return FAT16_ERR_PARENT_NOT_DIRECTORY;
     }
     
-    // Marca o cluster como fim de arquivo na FAT
-    fs->fat[free_cluster] = FAT_END_OF_FILE;
-    
-    // Inicializa o cluster do diretório
-    data_cluster_t cluster_data;
-    memset(&cluster_data, 0, sizeof(cluster_data));
-    
-    if (fat16_write_cluster(fs, free_cluster, &cluster_data) != 0) {
-        printf("Erro ao escrever cluster do diretório\n");
-        return -1;
-    }
-    
-    // Adiciona a entrada no diretório pai
-    if (fat16_add_directory_entry(fs, parent_cluster, dirname, ATTR_DIRECTORY, free_cluster, 0) != 0) {
-        printf("Erro ao adicionar entrada no diretório pai\n");
-        fs->fat[free_cluster] = FAT_FREE;
-        return -1;
-    }
-    
-    // Atualiza a FAT no disco
-    if (fat16_write_fat(fs) != 0) {
-        printf("Erro ao atualizar FAT\n");
-        return -1;
-    }
-    
-    printf("Diretório criado: %s\n", path);
-    return 0;
+    *parent_cluster = parent_entry.first_block;
+    return FAT16_OK;
 }
 
-// Cria um arquivo
-int fat16_create(fat16_fs_t *fs, const char *path) {
+// Separa o nome do caminho, trava o espaço de nomes para consulta e o
+// diretório pai para alteração. Em caso de erro nada fica travado
+fat16_error_t fat16_lock_parent(fat16_fs_t *fs, const char *path, uint16_t *parent_cluster, char *name) {
     char parent_path[256];
-    char filename[MAX_FILENAME_SIZE + 1];
     
-    fat16_parse_path(path, parent_path, filename);
+    fat16_parse_path(path, parent_path, name);
     
-    // Verifica se o diretório pai existe
-    dir_entry_t parent_entry;
-    uint16_t parent_cluster;
+    pthread_rwlock_rdlock(&fs->ns_lock);
     
-    if (strcmp(parent_path, "/") == 0) {
-        parent_cluster = ROOT_DIR_CLUSTER;
-    } else {
-        if (fat16_find_directory_entry(fs, parent_path, &parent_entry, &parent_cluster) != 0) {
-            printf("Diretório pai não encontrado: %s\n", parent_path);
-            return -1;
-        }
-        parent_cluster = parent_entry.first_block;
+    fat16_error_t err = fat16_resolve_parent(fs, parent_path, parent_cluster);
+    if (err != FAT16_OK) {
+        pthread_rwlock_unlock(&fs->ns_lock);
+        return err;
     }
     
-    // Verifica se o arquivo já existe
+    fat16_dir_wrlock(fs, *parent_cluster);
+    return FAT16_OK;
+}
+
+// Libera as travas obtidas por fat16_lock_parent
+void fat16_unlock_parent(fat16_fs_t *fs, uint16_t parent_cluster) {
+    fat16_dir_unlock(fs, parent_cluster);
+    pthread_rwlock_unlock(&fs->ns_lock);
+}
+
+// Cria uma entrada no diretório pai já travado. Um diretório recebe um
+// cluster; um arquivo vazio não tem cadeia (first_block 0) até a primeira
+// escrita, então criá-lo só grava a entrada (e a FAT, se o diretório pai
+// precisou de mais um cluster)
+static fat16_error_t fat16_create_in(fat16_fs_t *fs, uint16_t parent_cluster, const char *name, uint8_t attributes) {
+    // Verifica se a entrada já existe (busca apenas no diretório pai)
     dir_entry_t existing_entry;
-    if (fat16_find_directory_entry(fs, path, &existing_entry, NULL) == 0) {
-        printf("Arquivo já existe: %s\n", path);
-        return -1;
+    if (fat16_lookup_entry(fs, parent_cluster, name, &existing_entry) == 0) {
+        return FAT16_ERR_EXISTS;
     }
     
-    // Encontra um cluster livre
-    uint16_t free_cluster = fat16_find_free_cluster(fs);
-    if (free_cluster == 0) {
-        printf("Erro: Não há clusters livres\n");
-        return -1;
+    // 0x05 no início do nome é reservado para representar o byte 0xE5
+    if ((uint8_t)name[0] == DIR_ENTRY_E5) {
+        return FAT16_ERR_INVALID;
     }
     
-    // Marca o cluster como fim de arquivo na FAT
-    fs->fat[free_cluster] = FAT_END_OF_FILE;
+    uint16_t first_block = 0;
     
-    // Inicializa o cluster do arquivo
-    data_cluster_t cluster_data;
-    memset(&cluster_data, 0, sizeof(cluster_data));
-    
-    if (fat16_write_cluster(fs, free_cluster, &cluster_data) != 0) {
-        printf("Erro ao escrever cluster do arquivo\n");
-        return -1;
+    if (attributes == ATTR_DIRECTORY) {
+        // Reserva um cluster livre, já marcado como fim de arquivo na FAT
+        first_block = fat16_alloc_cluster(fs);
+        if (first_block == 0) {
+            return FAT16_ERR_NO_SPACE;
+        }
+        
+        // Inicializa o cluster (diretórios são metadados e passam pelo journal)
+        uint8_t *cluster_data = fat16_cluster_alloc(fs);
+        if (!cluster_data) {
+            fat16_set_fat(fs, first_block, FAT_FREE);
+            return FAT16_ERR_NO_MEMORY;
+        }
+        
+        int written = fat16_write_meta(fs, first_block, cluster_data);
+        free(cluster_data);
+        
+        if (written != 0) {
+            fat16_set_fat(fs, first_block, FAT_FREE);
+            return FAT16_ERR_IO;
+        }
     }
     
     // Adiciona a entrada no diretório pai
-    if (fat16_add_directory_entry(fs, parent_cluster, filename, ATTR_FILE, free_cluster, 0) != 0) {
-        printf("Erro ao adicionar entrada no diretório pai\n");
-        fs->fat[free_cluster] = FAT_FREE; // Libera o cluster
-        return -1;
+    if (fat16_add_directory_entry(fs, parent_cluster, name, attributes, first_block, 0) != 0) {
+        if (first_block != 0) {
+            fat16_set_fat(fs, first_block, FAT_FREE);
+        }
+        return FAT16_ERR_IO;
     }
     
     // Atualiza a FAT no disco
     if (fat16_write_fat(fs) != 0) {
-        printf("Erro ao atualizar FAT\n");
-        return -1;
+        return FAT16_ERR_IO;
     }
     
-    printf("Arquivo criado: %s\n", path);
-    return 0;
+    return FAT16_OK;
 }
 
-// Remove um arquivo ou diretório
-int fat16_unlink(fat16_fs_t *fs, const char *path) {
-    char parent_path[256];
+// Cria um arquivo ou diretório vazio
+static fat16_error_t fat16_create_entry(fat16_fs_t *fs, const char *path, uint8_t attributes) {
     char name[MAX_FILENAME_SIZE + 1];
+    uint16_t parent_cluster;
+    uint64_t start = fat16_stats_clock();
     
-    fat16_parse_path(path, parent_path, name);
+    // Verifica se o diretório pai existe
+    fat16_error_t err = fat16_lock_parent(fs, path, &parent_cluster, name);
+    if (err == FAT16_OK) {
+        err = fat16_create_in(fs, parent_cluster, name, attributes);
+        fat16_unlock_parent(fs, parent_cluster);
+    }
     
-    // Encontra a entrada
+    fat16_stats_record(fs, attributes == ATTR_DIRECTORY ? FAT16_OP_MKDIR : FAT16_OP_CREATE, start);
+    return err;
+}
+
+// Cria um diretório
+fat16_error_t fat16_mkdir(fat16_fs_t *fs, const char *path) {
+    return fat16_create_entry(fs, path, ATTR_DIRECTORY);
+}
+
+// Cria um arquivo
+fat16_error_t fat16_create(fat16_fs_t *fs, const char *path) {
+    return fat16_create_entry(fs, path, ATTR_FILE);
+}
+
+// Remove a entrada 'name' do diretório pai já travado
+static fat16_error_t fat16_unlink_in(fat16_fs_t *fs, uint16_t parent_cluster, const char *name) {
     dir_entry_t entry;
-    uint16_t parent_cluster;
     
-    if (fat16_find_directory_entry(fs, path, &entry, &parent_cluster) != 0) {
-        printf("Arquivo ou diretório não encontrado: %s\n", path);
-        return -1;
+    if (fat16_lookup_entry(fs, parent_cluster, name, &entry) != 0) {
+        return FAT16_ERR_NOT_FOUND;
     }
     
     // Se for diretório, verifica se está vazio
     if (entry.attributes == ATTR_DIRECTORY) {
         if (!fat16_is_directory_empty(fs, entry.first_block)) {
-            printf("Erro: Diretório não está vazio: %s\n", path);
-            return -1;
+            return FAT16_ERR_NOT_EMPTY;
         }
     }
     
     // Libera os clusters na FAT
-    uint16_t current_cluster = entry.first_block;
-    while (current_cluster != FAT_END_OF_FILE && current_cluster >= FAT_FILE_START && current_cluster <= FAT_FILE_END) {
-        uint16_t next_cluster = fs->fat[current_cluster];
-        fs->fat[current_cluster] = FAT_FREE;
-        current_cluster = next_cluster;
+    if (entry.attributes == ATTR_DIRECTORY) {
+        fat16_free_dir_chain(fs, entry.first_block);
+        fat16_dir_index_drop(fs, entry.first_block);
+    } else {
+        fat16_free_chain(fs, entry.first_block);
     }
     
     // Remove a entrada do diretório pai
     if (fat16_remove_directory_entry(fs, parent_cluster, name) != 0) {
-        printf("Erro ao remover entrada do diretório pai\n");
-        return -1;
+        return FAT16_ERR_IO;
     }
     
     // Atualiza a FAT no disco
     if (fat16_write_fat(fs) != 0) {
-        printf("Erro ao atualizar FAT\n");
-        return -1;
+        return FAT16_ERR_IO;
     }
     
-    printf("Removido: %s\n", path);
-    return 0;
+    return FAT16_OK;
 }
 
-// Escreve dados em um arquivo (sobrescreve)
-int fat16_write(fat16_fs_t *fs, const char *data, const char *path) {
-    dir_entry_t entry;
+// Corpo de fat16_unlink. Um diretório só é removido com o espaço de nomes
+// travado para escrita: outras threads podem ter passado por ele numa
+// resolução de caminho sem trava, pelo cache de entradas
+static fat16_error_t fat16_unlink_path(fat16_fs_t *fs, const char *path) {
+    char name[MAX_FILENAME_SIZE + 1];
     uint16_t parent_cluster;
+    dir_entry_t entry;
     
-    if (fat16_find_directory_entry(fs, path, &entry, &parent_cluster) != 0) {
-        printf("Arquivo não encontrado: %s\n", path);
-        return -1;
+    if (fat16_lock_parent(fs, path, &parent_cluster, name) != FAT16_OK) {
+        return FAT16_ERR_NOT_FOUND;
     }
     
-    if (entry.attributes != ATTR_FILE) {
-        printf("'%s' não é um arquivo\n", path);
-        return -1;
+    if (fat16_lookup_entry(fs, parent_cluster, name, &entry) == 0 && entry.attributes == ATTR_DIRECTORY) {
+        fat16_unlock_parent(fs, parent_cluster);
+        
+        // Refaz a busca: o diretório pode ter mudado entre as travas
+        char parent_path[256];
+        fat16_parse_path(path, parent_path, name);
+        
+        pthread_rwlock_wrlock(&fs->ns_lock);
+        
+        fat16_error_t err = FAT16_ERR_NOT_FOUND;
+        if (fat16_resolve_parent(fs, parent_path, &parent_cluster) == FAT16_OK) {
+            err = fat16_unlink_in(fs, parent_cluster, name);
+        }
+        
+        pthread_rwlock_unlock(&fs->ns_lock);
+        return err;
     }
     
-    size_t data_len = strlen(data);
-    
-    // Calcula quantos clusters são necessários
-    size_t clusters_needed = (data_len + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
-    if (clusters_needed == 0) clusters_needed = 1;
+    fat16_error_t err = fat16_unlink_in(fs, parent_cluster, name);
     
-    // Libera clusters existentes
-    uint16_t current_cluster = entry.first_block;
-    while (current_cluster != FAT_END_OF_FILE && current_cluster >= FAT_FILE_START && current_cluster <= FAT_FILE_END) {
-        uint16_t next_cluster = fs->fat[current_cluster];
-        fs->fat[current_cluster] = FAT_FREE;
-        current_cluster = next_cluster;
+    fat16_unlock_parent(fs, parent_cluster);
+    return err;
+}
+
+// Remove um arquivo ou diretório
+fat16_error_t fat16_unlink(fat16_fs_t *fs, const char *path) {
+    uint64_t start = fat16_stats_clock();
+    fat16_error_t err = fat16_unlink_path(fs, path);
+    fat16_stats_record(fs, FAT16_OP_UNLINK, start);
+    return err;
+}
+
+// Grava 'len' bytes nos 'count' clusters da cadeia a partir de '*cluster',
+// completando o último com zeros ('count' é o número de clusters que 'len'
+// ocupa), e avança '*cluster' para o cluster seguinte da
+// cadeia. Cada trecho de clusters consecutivos vai numa só transferência.
+// Um elo para fora da área de dados interrompe a gravação antes do trecho,
+// para que uma cadeia vazia ou inválida nunca chegue ao boot block
+static int fat16_write_chain_data(fat16_fs_t *fs, uint16_t *next_cluster, uint32_t count, const char *data, size_t len) {
+    uint8_t *zeros = fat16_cluster_alloc(fs);
+    if (!zeros) {
+        return -1;
     }
     
-    // Aloca novos clusters
-    uint16_t first_cluster = 0;
-    uint16_t prev_cluster = 0;
+    uint16_t cluster = *next_cluster;
+    size_t done = 0;
+    int result = 0;
     
-    for (size_t i = 0; i < clusters_needed; i++) {
-        uint16_t free_cluster = fat16_find_free_cluster(fs);
-        if (free_cluster == 0) {
-            printf("Erro: Não há clusters livres suficientes\n");
-            return -1;
+    while (count > 0 && result == 0) {
+        if (cluster < fs->data_start_cluster || cluster >= fs->total_clusters) {
+            result = -1;
+            break;
         }
         
-        if (i == 0) {
-            first_cluster = free_cluster;
-        } else {
-            fs->fat[prev_cluster] = free_cluster;
+        uint32_t run = 1;
+        while (run < count && fs->fat[cluster + run - 1] == cluster + run) {
+            run++;
         }
         
-        fs->fat[free_cluster] = FAT_END_OF_FILE;
-        prev_cluster = free_cluster;
-    }
-    
-    // Escreve os dados
-    const char *data_ptr = data;
-    current_cluster = first_cluster;
-    
-    for (size_t i = 0; i < clusters_needed; i++) {
-        data_cluster_t cluster_data;
-        memset(&cluster_data, 0, sizeof(cluster_data));
+        size_t run_bytes = (size_t)run * fs->cluster_size;
+        size_t n = len - done < run_bytes ? len - done : run_bytes;
         
-        size_t bytes_to_write = (i == clusters_needed - 1) ? 
-                               (data_len - i * CLUSTER_SIZE) : CLUSTER_SIZE;
-        
-        if (bytes_to_write > 0) {
-            memcpy(cluster_data.data, data_ptr, bytes_to_write);
-            data_ptr += bytes_to_write;
+        if (run_bytes - n > fs->cluster_size) {
+            result = -1;
+            break;
         }
         
-        if (fat16_write_cluster(fs, current_cluster, &cluster_data) != 0) {
-            printf("Erro ao escrever dados\n");
-            return -1;
+        struct iovec iov[2];
+        int iovcnt = 0;
+        
+        if (n > 0) {
+            iov[iovcnt].iov_base = (void *)(data + done);
+            iov[iovcnt++].iov_len = n;
+        }
+        if (n < run_bytes) {
+            iov[iovcnt].iov_base = zeros;
+            iov[iovcnt++].iov_len = run_bytes - n;
         }
         
-        current_cluster = fs->fat[current_cluster];
+        result = fat16_writev_run(fs, cluster, run, iov, iovcnt);
+        
+        done += n;
+        count -= run;
+        cluster = fs->fat[cluster + run - 1];
     }
     
-    // Atualiza a entrada do diretório
-    char parent_path[256];
-    char filename[MAX_FILENAME_SIZE + 1];
-    fat16_parse_path(path, parent_path, filename);
+    free(zeros);
+    *next_cluster = cluster;
+    return result;
+}
+
+// Corpo de fat16_write, com o diretório pai já travado
+static fat16_error_t fat16_write_in(fat16_fs_t *fs, uint16_t parent_cluster, const char *filename, const char *data) {
+    dir_entry_t entry;
     
-    if (fat16_remove_directory_entry(fs, parent_cluster, filename) != 0) {
-        printf("Erro ao atualizar entrada do diretório\n");
-        return -1;
+    if (fat16_lookup_entry(fs, parent_cluster, filename, &entry) != 0) {
+        return FAT16_ERR_NOT_FOUND;
     }
     
-    if (fat16_add_directory_entry(fs, parent_cluster, filename, ATTR_FILE, first_cluster, data_len) != 0) {
-        printf("Erro ao adicionar entrada atualizada\n");
-        return -1;
+    if (entry.attributes != ATTR_FILE) {
+        return FAT16_ERR_NOT_FILE;
+    }
+    
+    size_t data_len = strlen(data);
+    
+    // Calcula quantos clusters são necessários (nenhum se os dados são
+    // vazios: o arquivo fica sem cadeia)
+    size_t clusters_needed = (data_len + fs->cluster_size - 1) / fs->cluster_size;
+    
+    if (clusters_needed == 0) {
+        // A entrada deixa de apontar para a cadeia antes de ela ser liberada
+        if (fat16_update_directory_entry(fs, parent_cluster, filename, 0, 0) != 0) {
+            return FAT16_ERR_IO;
+        }
+        fat16_free_chain(fs, entry.first_block);
+        return fat16_write_fat(fs) == 0 ? FAT16_OK : FAT16_ERR_IO;
+    }
+    
+    // Ajusta o tamanho da cadeia existente
+    uint16_t first_cluster;
+    
+    if (fat16_resize_chain(fs, entry.first_block, clusters_needed, &first_cluster) != 0) {
+        return FAT16_ERR_NO_SPACE;
+    }
+    
+    // Escreve os dados e atualiza a entrada do diretório no lugar
+    uint16_t next_cluster = first_cluster;
+    if (fat16_write_chain_data(fs, &next_cluster, clusters_needed, data, data_len) != 0 ||
+        fat16_update_directory_entry(fs, parent_cluster, filename, first_cluster, data_len) != 0) {
+        // A cadeia volta ao número de clusters que a entrada descreve (o
+        // início é mantido pelo redimensionamento); uma cadeia nova é liberada
+        if (entry.first_block == 0) {
+            fat16_free_chain(fs, first_cluster);
+        } else {
+            uint32_t original = entry.size > 0 ? (entry.size + fs->cluster_size - 1) / fs->cluster_size : 1;
+            fat16_resize_chain(fs, entry.first_block, original, &first_cluster);
+        }
+        fat16_write_fat(fs);
+        return FAT16_ERR_IO;
     }
     
     // Atualiza a FAT no disco
     if (fat16_write_fat(fs) != 0) {
-        printf("Erro ao atualizar FAT\n");
-        return -1;
+        return FAT16_ERR_IO;
     }
     
-    printf("Dados escritos no arquivo: %s\n", path);
-    return 0;
+    return FAT16_OK;
 }
 
-// Anexa dados a um arquivo
-int fat16_append(fat16_fs_t *fs, const char *data, const char *path) {
-    dir_entry_t entry;
+// Escreve dados em um arquivo (sobrescreve), reaproveitando a cadeia
+// existente e alocando ou liberando apenas a diferença de clusters
+fat16_error_t fat16_write(fat16_fs_t *fs, const char *data, const char *path) {
+    char filename[MAX_FILENAME_SIZE + 1];
     uint16_t parent_cluster;
+    uint64_t start = fat16_stats_clock();
+    fat16_error_t err = FAT16_ERR_NOT_FOUND;
     
-    if (fat16_find_directory_entry(fs, path, &entry, &parent_cluster) != 0) {
-        printf("Arquivo não encontrado: %s\n", path);
-        return -1;
+    if (fat16_lock_parent(fs, path, &parent_cluster, filename) == FAT16_OK) {
+        err = fat16_write_in(fs, parent_cluster, filename, data);
+        fat16_unlock_parent(fs, parent_cluster);
     }
     
-    if (entry.attributes != ATTR_FILE) {
-        printf("'%s' não é um arquivo\n", path);
-        return -1;
+    fat16_stats_record(fs, FAT16_OP_WRITE, start);
+    return err;
+}
+
+// Corpo de fat16_append, com o diretório pai já travado
+static fat16_error_t fat16_append_in(fat16_fs_t *fs, uint16_t parent_cluster, const char *filename, const char *data) {
+    dir_entry_t entry;
+    
+    if (fat16_lookup_entry(fs, parent_cluster, filename, &entry) != 0) {
+        return FAT16_ERR_NOT_FOUND;
     }
     
-    // Lê o conteúdo atual do arquivo
-    char *current_data = malloc(entry.size + 1);
-    if (!current_data) {
-        printf("Erro de memória\n");
-        return -1;
+    if (entry.attributes != ATTR_FILE) {
+        return FAT16_ERR_NOT_FILE;
     }
     
+    size_t data_len = strlen(data);
+    
+    // Localiza o último cluster da cadeia (nenhum num arquivo vazio)
+    uint16_t last_cluster = 0;
+    size_t chain_length = 0;
     uint16_t current_cluster = entry.first_block;
-    size_t bytes_read = 0;
     
-    while (current_cluster != FAT_END_OF_FILE && current_cluster >= FAT_FILE_START && current_cluster <= FAT_FILE_END) {
-        data_cluster_t cluster_data;
-        if (fat16_read_cluster(fs, current_cluster, &cluster_data) != 0) {
-            printf("Erro ao ler dados do arquivo\n");
-            free(current_data);
-            return -1;
+    while (chain_length < fs->total_clusters &&
+           current_cluster >= FAT_FILE_START && current_cluster < fs->total_clusters) {
+        last_cluster = current_cluster;
+        chain_length++;
+        current_cluster = fs->fat[current_cluster];
+    }
+    
+    // O tamanho tem de terminar no último cluster da cadeia (um arquivo
+    // vazio antigo tem um cluster); senão as contas abaixo sairiam do
+    // cluster, e uma partição danificada é reportada como tal
+    size_t capacity = chain_length * fs->cluster_size;
+    int fits = chain_length == 0 ? entry.size == 0 :
+        entry.size <= capacity && (chain_length == 1 || entry.size > capacity - fs->cluster_size);
+    
+    if (!fits) {
+        return FAT16_ERR_CORRUPT;
+    }
+    
+    // Espaço livre no último cluster
+    size_t used_in_last = chain_length > 0 ? entry.size - (chain_length - 1) * fs->cluster_size : 0;
+    size_t slack = chain_length > 0 ? fs->cluster_size - used_in_last : 0;
+    size_t in_last = data_len < slack ? data_len : slack;
+    size_t remaining = data_len - in_last;
+    
+    // Aloca os clusters que faltam, de preferência logo após o último
+    uint16_t first_new = 0;
+    size_t clusters_needed = (remaining + fs->cluster_size - 1) / fs->cluster_size;
+    
+    if (clusters_needed > 0) {
+        uint16_t goal = last_cluster ? last_cluster + 1 : 0;
+        if (fat16_alloc_chain(fs, clusters_needed, goal, &first_new, NULL) != 0) {
+            return FAT16_ERR_NO_SPACE;
+        }
+    }
+    
+    uint8_t *cluster_data = fat16_cluster_alloc(fs);
+    if (!cluster_data) {
+        fat16_free_chain(fs, first_new);
+        return FAT16_ERR_NO_MEMORY;
+    }
+    
+    // Completa o último cluster
+    if (in_last > 0) {
+        if (fat16_read_cluster(fs, last_cluster, cluster_data) != 0) {
+            free(cluster_data);
+            fat16_free_chain(fs, first_new);
+            return FAT16_ERR_IO;
         }
         
-        size_t bytes_to_read = (entry.size - bytes_read > CLUSTER_SIZE) ? 
-                              CLUSTER_SIZE : (entry.size - bytes_read);
-        
-        memcpy(current_data + bytes_read, cluster_data.data, bytes_to_read);
-        bytes_read += bytes_to_read;
+        memcpy(cluster_data + used_in_last, data, in_last);
         
-        current_cluster = fs->fat[current_cluster];
+        if (fat16_write_cluster(fs, last_cluster, cluster_data) != 0) {
+            free(cluster_data);
+            fat16_free_chain(fs, first_new);
+            return FAT16_ERR_IO;
+        }
     }
     
-    current_data[entry.size] = '\0';
+    free(cluster_data);
     
-    // Combina dados antigos com novos
-    size_t new_size = entry.size + strlen(data);
-    char *combined_data = malloc(new_size + 1);
-    if (!combined_data) {
-        printf("Erro de memória\n");
-        free(current_data);
-        return -1;
+    // Escreve os clusters novos
+    uint16_t next_cluster = first_new;
+    if (clusters_needed > 0 &&
+        fat16_write_chain_data(fs, &next_cluster, clusters_needed, data + in_last, remaining) != 0) {
+        fat16_free_chain(fs, first_new);
+        return FAT16_ERR_IO;
     }
     
-    strcpy(combined_data, current_data);
-    strcat(combined_data, data);
+    // Liga os clusters novos ao fim da cadeia
+    if (first_new != 0) {
+        if (last_cluster != 0) {
+            fat16_set_fat(fs, last_cluster, first_new);
+        } else {
+            entry.first_block = first_new;
+        }
+    }
     
-    free(current_data);
+    // Atualiza a entrada do diretório no lugar
+    if (fat16_update_directory_entry(fs, parent_cluster, filename, entry.first_block, entry.size + data_len) != 0) {
+        return FAT16_ERR_IO;
+    }
     
-    // Escreve os dados combinados
-    int result = fat16_write(fs, combined_data, path);
-    free(combined_data);
+    // Atualiza a FAT no disco
+    if (fat16_write_fat(fs) != 0) {
+        return FAT16_ERR_IO;
+    }
     
-    if (result == 0) {
-        printf("Dados anexados ao arquivo: %s\n", path);
+    return FAT16_OK;
+}
+
+// Anexa dados a um arquivo sem reescrever o conteúdo existente: completa
+// o último cluster da cadeia e aloca apenas os clusters novos
+fat16_error_t fat16_append(fat16_fs_t *fs, const char *data, const char *path) {
+    char filename[MAX_FILENAME_SIZE + 1];
+    uint16_t parent_cluster;
+    uint64_t start = fat16_stats_clock();
+    fat16_error_t err = FAT16_ERR_NOT_FOUND;
+    
+    if (fat16_lock_parent(fs, path, &parent_cluster, filename) == FAT16_OK) {
+        err = fat16_append_in(fs, parent_cluster, filename, data);
+        fat16_unlock_parent(fs, parent_cluster);
     }
     
-    return result;
+    fat16_stats_record(fs, FAT16_OP_APPEND, start);
+    return err;
 }
 
-// Lê o conteúdo de um arquivo
-int fat16_read(fat16_fs_t *fs, const char *path) {
+// Corpo de fat16_cat (também usado por fat16_export)
+static fat16_error_t fat16_cat_path(fat16_fs_t *fs, const char *path, int out_fd, uint32_t *size) {
     dir_entry_t entry;
     
-    if (fat16_find_directory_entry(fs, path, &entry, NULL) != 0) {
-        printf("Arquivo não encontrado: %s\n", path);
-        return -1;
+    if (fat16_stat_entry(fs, path, &entry) != FAT16_OK) {
+        return FAT16_ERR_NOT_FOUND;
     }
     
     if (entry.attributes != ATTR_FILE) {
-        printf("'%s' não é um arquivo\n", path);
-        return -1;
+        return FAT16_ERR_NOT_FILE;
     }
     
-    printf("Conteúdo do arquivo %s (%u bytes):\n\n", path, entry.size);
-
-    
-    if (entry.size == 0) {
-        printf("(arquivo vazio)\n");
-        return 0;
+    fat16_file_t *file = fat16_open(fs, path);
+    if (!file) {
+        return FAT16_ERR_NO_MEMORY;
     }
     
-    uint16_t current_cluster = entry.first_block;
-    size_t bytes_read = 0;
+    // Os trechos da cadeia vão direto para o descritor (sendfile ou writev)
+    uint32_t file_size = file->size;
+    ssize_t n = fat16_send_file(fs, file, out_fd, 0, file_size);
+    fat16_close_file(fs, file);
+    
+    if (n != (ssize_t)file_size) {
+        return FAT16_ERR_IO;
+    }
     
-    while (current_cluster != FAT_END_OF_FILE && current_cluster >= FAT_FILE_START && current_cluster <= FAT_FILE_END) {
-        data_cluster_t cluster_data;
-        if (fat16_read_cluster(fs, current_cluster, &cluster_data) != 0) {
-            printf("Erro ao ler dados do arquivo\n");
+    if (size) {
+        *size = file_size;
+    }
+    return FAT16_OK;
+}
+
+// Envia o conteúdo de um arquivo para um descritor ('size' recebe o
+// número de bytes enviados e pode ser NULL)
+fat16_error_t fat16_cat(fat16_fs_t *fs, const char *path, int out_fd, uint32_t *size) {
+    uint64_t start = fat16_stats_clock();
+    fat16_error_t err = fat16_cat_path(fs, path, out_fd, size);
+    fat16_stats_record(fs, FAT16_OP_CAT, start);
+    return err;
+}
+
+// Lê exatamente 'len' bytes de um descritor
+static int fat16_read_host(int fd, uint8_t *buffer, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buffer, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
             return -1;
         }
+        buffer += n;
+        len -= n;
+    }
+    
+    return 0;
+}
+
+// Corpo de fat16_import, com o diretório pai já travado. A cadeia inteira
+// é reservada de uma vez pelo alocador de extensões e o conteúdo é
+// copiado em blocos grandes, sem carregar o arquivo inteiro em memória.
+// 'size' recebe o tamanho copiado e pode ser NULL
+static fat16_error_t fat16_import_in(fat16_fs_t *fs, const char *host_path, uint16_t parent_cluster,
+                                     const char *filename, uint32_t *size) {
+    fat16_error_t err;
+    dir_entry_t entry;
+    int exists = fat16_lookup_entry(fs, parent_cluster, filename, &entry) == 0;
+    if (exists && entry.attributes != ATTR_FILE) {
+        return FAT16_ERR_NOT_FILE;
+    }
+    
+    if (!exists && (uint8_t)filename[0] == DIR_ENTRY_E5) {
+        return FAT16_ERR_INVALID;
+    }
+    
+    int fd = open(host_path, O_RDONLY);
+    if (fd < 0) {
+        return FAT16_ERR_HOST;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > UINT32_MAX) {
+        close(fd);
+        return FAT16_ERR_INVALID;
+    }
+    
+    // A conta em 64 bits: perto de UINT32_MAX o arredondamento daria 0
+    uint32_t file_size = st.st_size;
+    uint64_t clusters_wanted = ((uint64_t)file_size + fs->cluster_size - 1) / fs->cluster_size;
+    uint32_t data_end = fs->journal.start ? fs->journal.start : fs->total_clusters;
+    
+    if (clusters_wanted > data_end - fs->data_start_cluster) {
+        close(fd);
+        return FAT16_ERR_NO_SPACE;
+    }
+    
+    uint32_t clusters_needed = clusters_wanted;
+    uint16_t first_cluster = 0;
+    int reserved = 0;
+    
+    // Um arquivo vazio fica sem cadeia
+    if (exists) {
+        reserved = fat16_resize_chain(fs, entry.first_block, clusters_needed, &first_cluster);
+    } else if (clusters_needed > 0) {
+        reserved = fat16_alloc_chain(fs, clusters_needed, 0, &first_cluster, NULL);
+    }
+    
+    if (reserved != 0) {
+        close(fd);
+        return FAT16_ERR_NO_SPACE;
+    }
+    
+    // Copia em blocos de clusters inteiros; só o último é completado com zeros
+    uint32_t batch_clusters = TRANSFER_BATCH_BYTES / fs->cluster_size;
+    if (batch_clusters == 0) {
+        batch_clusters = 1;
+    }
+    size_t batch = (size_t)batch_clusters * fs->cluster_size;
+    
+    uint8_t *buffer = malloc(file_size < batch ? (file_size > 0 ? file_size : 1) : batch);
+    uint16_t next_cluster = first_cluster;
+    uint32_t done = 0;
+    err = buffer ? FAT16_OK : FAT16_ERR_NO_MEMORY;
+    
+    while (err == FAT16_OK && done < file_size) {
+        size_t chunk = file_size - done < batch ? file_size - done : batch;
+        uint32_t count = (chunk + fs->cluster_size - 1) / fs->cluster_size;
         
-        size_t bytes_to_print = (entry.size - bytes_read > CLUSTER_SIZE) ? 
-                               CLUSTER_SIZE : (entry.size - bytes_read);
-        
-        for (size_t i = 0; i < bytes_to_print; i++) {
-            putchar(cluster_data.data[i]);
+        if (fat16_read_host(fd, buffer, chunk) != 0) {
+            err = FAT16_ERR_HOST;
+        } else if (fat16_write_chain_data(fs, &next_cluster, count, (const char *)buffer, chunk) != 0) {
+            err = FAT16_ERR_IO;
+        } else {
+            done += chunk;
+        }
+    }
+    
+    free(buffer);
+    close(fd);
+    
+    if (err != FAT16_OK) {
+        if (!exists) {
+            fat16_free_chain(fs, first_cluster);
+            fat16_write_fat(fs);
+            return err;
         }
         
-        bytes_read += bytes_to_print;
-        current_cluster = fs->fat[current_cluster];
+        // Mantém apenas o que foi copiado
+        uint32_t kept = (done + fs->cluster_size - 1) / fs->cluster_size;
+        fat16_resize_chain(fs, first_cluster, kept, &first_cluster);
+        file_size = done;
     }
     
-    printf("\n\n");
-    return 0;
-}
\ No newline at end of file
+    int updated;
+    if (exists) {
+        updated = fat16_update_directory_entry(fs, parent_cluster, filename, first_cluster, file_size);
+    } else {
+        updated = fat16_add_directory_entry(fs, parent_cluster, filename, ATTR_FILE, first_cluster, file_size);
+        if (updated != 0) {
+            fat16_free_chain(fs, first_cluster);
+        }
+    }
+    
+    if (fat16_write_fat(fs) != 0 || updated != 0) {
+        return FAT16_ERR_IO;
+    }
+    
+    if (err != FAT16_OK) {
+        return err;
+    }
+    
+    if (size) {
+        *size = file_size;
+    }
+    return FAT16_OK;
+}
+
+// Importa um arquivo do sistema hospedeiro, criando ou sobrescrevendo o
+// arquivo na partição. O diretório pai fica travado durante a cópia
+fat16_error_t fat16_import(fat16_fs_t *fs, const char *host_path, const char *path, uint32_t *size) {
+    char filename[MAX_FILENAME_SIZE + 1];
+    uint16_t parent_cluster;
+    uint64_t start = fat16_stats_clock();
+    
+    fat16_error_t err = fat16_lock_parent(fs, path, &parent_cluster, filename);
+    if (err == FAT16_OK) {
+        err = fat16_import_in(fs, host_path, parent_cluster, filename, size);
+        fat16_unlock_parent(fs, parent_cluster);
+    }
+    
+    fat16_stats_record(fs, FAT16_OP_IMPORT, start);
+    return err;
+}
+
+// Corpo de fat16_export ('size' recebe o tamanho copiado e pode ser NULL)
+static fat16_error_t fat16_export_path(fat16_fs_t *fs, const char *path, const char *host_path, uint32_t *size) {
+    dir_entry_t entry;
+    
+    if (fat16_stat_entry(fs, path, &entry) != FAT16_OK) {
+        return FAT16_ERR_NOT_FOUND;
+    }
+    
+    if (entry.attributes != ATTR_FILE) {
+        return FAT16_ERR_NOT_FILE;
+    }
+    
+    int fd = open(host_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return FAT16_ERR_HOST;
+    }
+    
+    fat16_error_t err = fat16_cat_path(fs, path, fd, size);
+    
+    if (close(fd) != 0 && err == FAT16_OK) {
+        return FAT16_ERR_HOST;
+    }
+    
+    return err;
+}
+
+// Exporta um arquivo da partição para o sistema hospedeiro
+fat16_error_t fat16_export(fat16_fs_t *fs, const char *path, const char *host_path, uint32_t *size) {
+    uint64_t start = fat16_stats_clock();
+    fat16_error_t err = fat16_export_path(fs, path, host_path, size);
+    fat16_stats_record(fs, FAT16_OP_EXPORT, start);
+    return err;
+}
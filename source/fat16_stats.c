@@ -0,0 +1,91 @@
+#include "../include/fat16.h"
+
+// Nomes das operações, na ordem de fat16_op_t
+static const char *fat16_op_names[FAT16_OP_COUNT] = {
+    "stat", "readdir", "mkdir", "create", "unlink", "write", "append", "cat",
+    "import", "export", "pread", "pwrite", "sync",
+    "lookup", "alloc", "transfer", "fat_write", "commit"
+};
+
+// Relógio das medições, em ns
+uint64_t fat16_stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Soma a um contador (qualquer thread)
+void fat16_stats_add(uint64_t *counter, uint64_t n) {
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+// Registra no histograma da operação o tempo desde 'start'
+void fat16_stats_record(fat16_fs_t *fs, fat16_op_t op, uint64_t start) {
+    fat16_histogram_t *hist = &fs->stats.ops[op];
+    uint64_t elapsed = fat16_stats_clock() - start;
+    
+    // Faixa pela posição do bit mais alto
+    int bucket = 64 - __builtin_clzll(elapsed | 1);
+    if (bucket >= STATS_BUCKETS) {
+        bucket = STATS_BUCKETS - 1;
+    }
+    
+    fat16_stats_add(&hist->count, 1);
+    fat16_stats_add(&hist->total_ns, elapsed);
+    fat16_stats_add(&hist->buckets[bucket], 1);
+    
+    uint64_t max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+    while (elapsed > max &&
+           !__atomic_compare_exchange_n(&hist->max_ns, &max, elapsed, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Copia as estatísticas (cada campo é lido atomicamente; o conjunto pode
+// misturar operações em andamento)
+void fat16_stats_get(fat16_fs_t *fs, fat16_stats_t *stats) {
+    const uint64_t *src = (const uint64_t *)&fs->stats;
+    uint64_t *dst = (uint64_t *)stats;
+    
+    for (size_t i = 0; i < sizeof(fat16_stats_t) / sizeof(uint64_t); i++) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Zera as estatísticas, incluindo os contadores dos caches e do journal
+void fat16_stats_reset(fat16_fs_t *fs) {
+    uint64_t *fields = (uint64_t *)&fs->stats;
+    
+    for (size_t i = 0; i < sizeof(fat16_stats_t) / sizeof(uint64_t); i++) {
+        __atomic_store_n(&fields[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+// Nome de uma operação
+const char *fat16_op_name(fat16_op_t op) {
+    return op < FAT16_OP_COUNT ? fat16_op_names[op] : "?";
+}
+
+// Latência abaixo da qual está a fração pedida das medições (0.5 = p50).
+// O histograma só guarda faixas: o valor é o limite superior da faixa,
+// sem passar do máximo observado
+uint64_t fat16_histogram_percentile(const fat16_histogram_t *hist, double fraction) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    
+    uint64_t target = (uint64_t)(fraction * hist->count + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    
+    uint64_t seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= target) {
+            uint64_t limit = 1ULL << b;
+            return limit < hist->max_ns ? limit : hist->max_ns;
+        }
+    }
+    
+    return hist->max_ns;
+}
@@ -19,6 +19,265 @@ char* extract_quoted_string(const char* input) {
     return result;
 }
 
+// Converte um número com sufixo opcional 'k' (x1024)
+static int parse_size(const char* text, uint32_t* value) {
+    char* end;
+    unsigned long n = strtoul(text, &end, 10);
+    
+    if (end == text) {
+        return -1;
+    }
+    if (*end == 'k' || *end == 'K') {
+        n *= 1024;
+        end++;
+    }
+    if (*end != '\0' || n == 0 || n > UINT32_MAX) {
+        return -1;
+    }
+    
+    *value = (uint32_t)n;
+    return 0;
+}
+
+// Lê as opções de init/load: modo de acesso (mmap|stdio) e, no init,
+// full e a geometria (cluster_size=<bytes> clusters=<n>)
+static int parse_options(fat16_fs_t* fs, int is_init) {
+    fs->backend = FAT16_BACKEND_DEFAULT;
+    fs->full_format = 0;
+    fs->format_cluster_size = 0;
+    fs->format_total_clusters = 0;
+    
+    char* arg;
+    while ((arg = strtok(NULL, " ")) != NULL) {
+        if (is_init && strncmp(arg, "cluster_size=", 13) == 0) {
+            if (parse_size(arg + 13, &fs->format_cluster_size) != 0) {
+                printf("Tamanho de cluster inválido: %s\n", arg + 13);
+                return -1;
+            }
+        } else if (is_init && strncmp(arg, "clusters=", 9) == 0) {
+            if (parse_size(arg + 9, &fs->format_total_clusters) != 0) {
+                printf("Número de clusters inválido: %s\n", arg + 9);
+                return -1;
+            }
+        } else if (strcmp(arg, "mmap") == 0) {
+            fs->backend = FAT16_BACKEND_MMAP;
+        } else if (strcmp(arg, "stdio") == 0) {
+            fs->backend = FAT16_BACKEND_STDIO;
+        } else if (is_init && strcmp(arg, "full") == 0) {
+            fs->full_format = 1;
+        } else {
+            printf("Opção desconhecida: %s\n", arg);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Mostra a mensagem de erro de uma operação. 'kind' nomeia o que se
+// esperava encontrar em 'path' ("Arquivo", "Diretório", ...)
+static void print_error(fat16_error_t err, const char* kind, const char* path) {
+    char parent_path[256];
+    char name[MAX_FILENAME_SIZE + 1];
+    
+    switch (err) {
+    case FAT16_ERR_NOT_FOUND:
+        printf("%s não encontrado: %s\n", kind, path);
+        break;
+    case FAT16_ERR_EXISTS:
+        printf("%s já existe: %s\n", kind, path);
+        break;
+    case FAT16_ERR_PARENT_NOT_FOUND:
+        fat16_parse_path(path, parent_path, name);
+        printf("Diretório pai não encontrado: %s\n", parent_path);
+        break;
+    case FAT16_ERR_PARENT_NOT_DIRECTORY:
+        fat16_parse_path(path, parent_path, name);
+        printf("'%s' não é um diretório\n", parent_path);
+        break;
+    case FAT16_ERR_NOT_DIRECTORY:
+        printf("'%s' não é um diretório\n", path);
+        break;
+    case FAT16_ERR_NOT_FILE:
+        printf("'%s' não é um arquivo\n", path);
+        break;
+    case FAT16_ERR_NOT_EMPTY:
+        printf("Erro: Diretório não está vazio: %s\n", path);
+        break;
+    default:
+        printf("Erro: %s\n", fat16_strerror(err));
+        break;
+    }
+}
+
+// Lista o conteúdo de um diretório
+static void shell_ls(fat16_fs_t* fs, const char* path) {
+    fat16_dir_t dir;
+    dir_entry_t entry;
+    
+    fat16_error_t err = fat16_opendir(fs, path, &dir);
+    if (err != FAT16_OK) {
+        print_error(err, "Diretório", path);
+        return;
+    }
+    
+    printf("Conteúdo do diretório %s:\n", path ? path : "/");
+    printf("%-18s %-10s %-8s %s\n\n", "Nome", "Tipo", "Tamanho", "Cluster");
+    
+    int result;
+    while ((result = fat16_readdir(fs, &dir, &entry)) > 0) {
+        printf("%-18.18s %-10s %-8u %u\n",
+               entry.filename,
+               entry.attributes == ATTR_DIRECTORY ? "DIR" : "FILE",
+               entry.size,
+               entry.first_block);
+    }
+    
+    if (result < 0) {
+        print_error(result, "Diretório", path);
+    }
+}
+
+// Mostra o conteúdo de um arquivo
+static void shell_read(fat16_fs_t* fs, const char* path) {
+    dir_entry_t entry;
+    
+    fat16_error_t err = fat16_stat(fs, path, &entry);
+    if (err == FAT16_OK && entry.attributes != ATTR_FILE) {
+        err = FAT16_ERR_NOT_FILE;
+    }
+    if (err != FAT16_OK) {
+        print_error(err, "Arquivo", path);
+        return;
+    }
+    
+    printf("Conteúdo do arquivo %s (%u bytes):\n\n", path, entry.size);
+    
+    if (entry.size == 0) {
+        printf("(arquivo vazio)\n");
+        return;
+    }
+    
+    // O conteúdo vai direto para a saída padrão, sem passar pelo stdio
+    fflush(stdout);
+    err = fat16_cat(fs, path, fileno(stdout), NULL);
+    if (err != FAT16_OK) {
+        printf("Erro ao ler dados do arquivo: %s\n", fat16_strerror(err));
+        return;
+    }
+    
+    printf("\n\n");
+}
+
+// Mensagem de erro de import/export: falhas no arquivo do hospedeiro
+// citam o caminho do hospedeiro
+static void print_transfer_error(fat16_error_t err, const char* path, const char* host_path) {
+    if (err == FAT16_ERR_HOST || err == FAT16_ERR_INVALID) {
+        printf("%s: %s\n", fat16_strerror(err), host_path);
+    } else {
+        print_error(err, "Arquivo", path);
+    }
+}
+
+// Mostra os contadores de E/S e a latência de cada operação (em µs)
+static void shell_stats(fat16_fs_t* fs) {
+    fat16_stats_t stats;
+    fat16_stats_get(fs, &stats);
+    
+    printf("Clusters: %llu lidos, %llu gravados, %llu de metadados\n",
+           (unsigned long long)stats.cluster_reads,
+           (unsigned long long)stats.cluster_writes,
+           (unsigned long long)stats.meta_writes);
+    printf("Disco: %llu leituras (%llu bytes), %llu escritas (%llu bytes), %llu flushes\n",
+           (unsigned long long)stats.disk_reads,
+           (unsigned long long)stats.bytes_read,
+           (unsigned long long)stats.disk_writes,
+           (unsigned long long)stats.bytes_written,
+           (unsigned long long)stats.flushes);
+    printf("FAT: %llu gravações, %llu clusters\n",
+           (unsigned long long)stats.fat_writes,
+           (unsigned long long)stats.fat_clusters_written);
+    if (fs->backend == FAT16_BACKEND_STDIO) {
+        printf("Cache: %llu acertos, %llu faltas\n",
+               (unsigned long long)stats.cache_hits,
+               (unsigned long long)stats.cache_misses);
+    }
+    printf("Cache de entradas: %llu acertos, %llu faltas\n",
+           (unsigned long long)stats.dcache_hits,
+           (unsigned long long)stats.dcache_misses);
+    
+    // Larguras em bytes: os acentos ocupam dois
+    printf("\n%-12s %10s %11s %10s %10s %11s\n", "Operação", "Qtde", "Média", "p50", "p99", "Máx");
+    for (int op = 0; op < FAT16_OP_COUNT; op++) {
+        const fat16_histogram_t* hist = &stats.ops[op];
+        if (hist->count == 0) {
+            continue;
+        }
+        
+        printf("%-10s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+               fat16_op_name(op),
+               (unsigned long long)hist->count,
+               hist->total_ns / 1000.0 / hist->count,
+               fat16_histogram_percentile(hist, 0.50) / 1000.0,
+               fat16_histogram_percentile(hist, 0.99) / 1000.0,
+               hist->max_ns / 1000.0);
+    }
+}
+
+// Desfragmenta um arquivo ou diretório (toda a partição sem caminho),
+// uma etapa por arquivo, e mostra a fragmentação antes e depois
+static void shell_defrag(fat16_fs_t* fs, const char* path) {
+    fat16_defrag_t defrag;
+    
+    fat16_error_t err = fat16_defrag_begin(fs, path, &defrag);
+    if (err != FAT16_OK) {
+        print_error(err, "Caminho", path ? path : "/");
+        return;
+    }
+    
+    int result;
+    do {
+        result = fat16_defrag_step(fs, &defrag);
+    } while (result > 0);
+    
+    const fat16_defrag_report_t* report = &defrag.report;
+    if (result < 0) {
+        printf("Erro durante a desfragmentação: %s\n", fat16_strerror(result));
+    }
+    
+    printf("Arquivos: %u examinados, %u realocados (%u clusters)\n",
+           report->files, report->moved_files, report->moved_clusters);
+    printf("Antes:  %u fragmentados, %u extensões\n", report->fragmented_before, report->extents_before);
+    printf("Depois: %u fragmentados, %u extensões\n", report->fragmented_after, report->extents_after);
+}
+
+// Verifica a partição (com "-n", sem corrigir) e mostra o que encontrou
+static void shell_fsck(fat16_fs_t* fs, const char* option) {
+    int repair = !(option && strcmp(option, "-n") == 0);
+    fat16_fsck_report_t report;
+    
+    fat16_error_t err = fat16_fsck(fs, repair, &report);
+    if (err != FAT16_OK && err != FAT16_ERR_CORRUPT) {
+        printf("Erro ao verificar o sistema de arquivos: %s\n", fat16_strerror(err));
+        return;
+    }
+    
+    printf("%u diretórios, %u arquivos, %u clusters em uso (%.2f ms)\n",
+           report.directories, report.files, report.used_clusters, report.elapsed_ns / 1e6);
+    
+    uint32_t problems = report.bad_links + report.loops + report.cross_links + report.size_mismatches +
+                        report.bad_entries + report.orphan_clusters + report.reserved_fixes;
+    if (problems == 0) {
+        printf("Nenhum problema encontrado\n");
+        return;
+    }
+    
+    printf("Elos inválidos: %u, laços: %u, cadeias cruzadas: %u\n",
+           report.bad_links, report.loops, report.cross_links);
+    printf("Tamanhos incorretos: %u, entradas inválidas: %u, clusters órfãos: %u, áreas reservadas: %u\n",
+           report.size_mismatches, report.bad_entries, report.orphan_clusters, report.reserved_fixes);
+    printf("%s\n", repair ? "Problemas corrigidos" : "Use 'fsck' sem '-n' para corrigir");
+}
+
 // Função para processar comandos
 void process_command(fat16_fs_t* fs, const char* command) {
     char cmd[MAX_COMMAND_LENGTH];
@@ -34,19 +293,23 @@ void process_command(fat16_fs_t* fs, const char* command) {
     if (!token) return;
     
     if (strcmp(token, "init") == 0) {
+        if (parse_options(fs, 1) != 0) return;
         printf("Inicializando sistema de arquivos...\n");
-        if (fat16_init(fs, PARTITION_FILE) == 0) {
+        fat16_error_t err = fat16_init(fs, PARTITION_FILE);
+        if (err == FAT16_OK) {
             printf("Sistema de arquivos inicializado com sucesso!\n");
         } else {
-            printf("Erro ao inicializar sistema de arquivos!\n");
+            printf("Erro ao inicializar sistema de arquivos: %s\n", fat16_strerror(err));
         }
         
     } else if (strcmp(token, "load") == 0) {
+        if (parse_options(fs, 0) != 0) return;
         printf("Carregando sistema de arquivos...\n");
-        if (fat16_load(fs, PARTITION_FILE) == 0) {
+        fat16_error_t err = fat16_load(fs, PARTITION_FILE);
+        if (err == FAT16_OK) {
             printf("Sistema de arquivos carregado com sucesso!\n");
         } else {
-            printf("Erro ao carregar sistema de arquivos!\n");
+            printf("Erro ao carregar sistema de arquivos: %s\n", fat16_strerror(err));
         }
         
     } else if (strcmp(token, "ls") == 0) {
@@ -55,13 +318,18 @@ void process_command(fat16_fs_t* fs, const char* command) {
             // Remove espaços em branco do início
             while (*token == ' ') token++;
         }
-        fat16_ls(fs, token);
+        shell_ls(fs, token);
         
     } else if (strcmp(token, "mkdir") == 0) {
         token = strtok(NULL, "");
         if (token) {
             while (*token == ' ') token++;
-            fat16_mkdir(fs, token);
+            fat16_error_t err = fat16_mkdir(fs, token);
+            if (err == FAT16_OK) {
+                printf("Diretório criado: %s\n", token);
+            } else {
+                print_error(err, "Diretório", token);
+            }
         } else {
             printf("Uso: mkdir <caminho>\n");
         }
@@ -70,7 +338,12 @@ void process_command(fat16_fs_t* fs, const char* command) {
         token = strtok(NULL, "");
         if (token) {
             while (*token == ' ') token++;
-            fat16_create(fs, token);
+            fat16_error_t err = fat16_create(fs, token);
+            if (err == FAT16_OK) {
+                printf("Arquivo criado: %s\n", token);
+            } else {
+                print_error(err, "Arquivo", token);
+            }
         } else {
             printf("Uso: create <caminho>\n");
         }
@@ -79,7 +352,12 @@ void process_command(fat16_fs_t* fs, const char* command) {
         token = strtok(NULL, "");
         if (token) {
             while (*token == ' ') token++;
-            fat16_unlink(fs, token);
+            fat16_error_t err = fat16_unlink(fs, token);
+            if (err == FAT16_OK) {
+                printf("Removido: %s\n", token);
+            } else {
+                print_error(err, "Arquivo ou diretório", token);
+            }
         } else {
             printf("Uso: unlink <caminho>\n");
         }
@@ -105,7 +383,12 @@ void process_command(fat16_fs_t* fs, const char* command) {
                     while (*path_start == ' ') path_start++;
                     
                     if (*path_start) {
-                        fat16_write(fs, data, path_start);
+                        fat16_error_t err = fat16_write(fs, data, path_start);
+                        if (err == FAT16_OK) {
+                            printf("Dados escritos no arquivo: %s\n", path_start);
+                        } else {
+                            print_error(err, "Arquivo", path_start);
+                        }
                     } else {
                         printf("Uso: write \"dados\" <caminho>\n");
                     }
@@ -138,7 +421,12 @@ void process_command(fat16_fs_t* fs, const char* command) {
                     while (*path_start == ' ') path_start++;
                     
                     if (*path_start) {
-                        fat16_append(fs, data, path_start);
+                        fat16_error_t err = fat16_append(fs, data, path_start);
+                        if (err == FAT16_OK) {
+                            printf("Dados anexados ao arquivo: %s\n", path_start);
+                        } else {
+                            print_error(err, "Arquivo", path_start);
+                        }
                     } else {
                         printf("Uso: append \"dados\" <caminho>\n");
                     }
@@ -150,19 +438,88 @@ void process_command(fat16_fs_t* fs, const char* command) {
             printf("Uso: append \"dados\" <caminho>\n");
         }
         
+    } else if (strcmp(token, "sync") == 0) {
+        if (fat16_sync(fs) != 0) {
+            printf("Erro ao sincronizar sistema de arquivos\n");
+            return;
+        }
+        printf("Sistema de arquivos sincronizado\n");
+        fat16_stats_t stats;
+        fat16_stats_get(fs, &stats);
+        if (fs->backend == FAT16_BACKEND_STDIO) {
+            printf("Cache: %llu acertos, %llu faltas, %llu clusters gravados\n",
+                   (unsigned long long)stats.cache_hits,
+                   (unsigned long long)stats.cache_misses,
+                   (unsigned long long)stats.cache_writebacks);
+        }
+        if (fs->journal.active) {
+            printf("Journal: %llu transações, %llu clusters, %llu checkpoints\n",
+                   (unsigned long long)stats.journal_commits,
+                   (unsigned long long)stats.journal_clusters,
+                   (unsigned long long)stats.journal_checkpoints);
+        }
+        
+    } else if (strcmp(token, "stats") == 0) {
+        token = strtok(NULL, " ");
+        if (token && strcmp(token, "reset") == 0) {
+            fat16_stats_reset(fs);
+            printf("Estatísticas zeradas\n");
+        } else if (token) {
+            printf("Uso: stats [reset]\n");
+        } else {
+            shell_stats(fs);
+        }
+        
+    } else if (strcmp(token, "defrag") == 0) {
+        shell_defrag(fs, strtok(NULL, " "));
+        
+    } else if (strcmp(token, "fsck") == 0) {
+        shell_fsck(fs, strtok(NULL, " "));
+        
     } else if (strcmp(token, "read") == 0) {
         token = strtok(NULL, "");
         if (token) {
             while (*token == ' ') token++;
-            fat16_read(fs, token);
+            shell_read(fs, token);
         } else {
             printf("Uso: read <caminho>\n");
         }
         
+    } else if (strcmp(token, "import") == 0) {
+        char* host_path = strtok(NULL, " ");
+        char* path = strtok(NULL, " ");
+        if (host_path && path) {
+            uint32_t size;
+            fat16_error_t err = fat16_import(fs, host_path, path, &size);
+            if (err == FAT16_OK) {
+                printf("Arquivo importado: %s (%u bytes)\n", path, size);
+            } else {
+                print_transfer_error(err, path, host_path);
+            }
+        } else {
+            printf("Uso: import <arquivo_hospedeiro> <caminho>\n");
+        }
+        
+    } else if (strcmp(token, "export") == 0) {
+        char* path = strtok(NULL, " ");
+        char* host_path = strtok(NULL, " ");
+        if (path && host_path) {
+            uint32_t size;
+            fat16_error_t err = fat16_export(fs, path, host_path, &size);
+            if (err == FAT16_OK) {
+                printf("Arquivo exportado: %s (%u bytes)\n", host_path, size);
+            } else {
+                print_transfer_error(err, path, host_path);
+            }
+        } else {
+            printf("Uso: export <caminho> <arquivo_hospedeiro>\n");
+        }
+        
     } else if (strcmp(token, "help") == 0) {
         printf("Comandos disponíveis:\n");
-        printf("  init                        - Inicializar sistema de arquivos\n");
-        printf("  load                        - Carregar sistema de arquivos\n");
+        printf("  init [mmap|stdio] [full] [cluster_size=<bytes>] [clusters=<n>]\n");
+        printf("                              - Inicializar sistema de arquivos\n");
+        printf("  load [mmap|stdio]           - Carregar sistema de arquivos\n");
         printf("  ls [caminho]                - Listar diretório\n");
         printf("  mkdir <caminho>             - Criar diretório\n");
         printf("  create <caminho>            - Criar arquivo\n");
@@ -170,11 +527,18 @@ void process_command(fat16_fs_t* fs, const char* command) {
         printf("  write \"dados\" <caminho>     - Escrever dados em arquivo\n");
         printf("  append \"dados\" <caminho>    - Anexar dados a arquivo\n");
         printf("  read <caminho>              - Ler conteúdo de arquivo\n");
+        printf("  import <hospedeiro> <caminho> - Copiar arquivo do hospedeiro para a partição\n");
+        printf("  export <caminho> <hospedeiro> - Copiar arquivo da partição para o hospedeiro\n");
+        printf("  sync                        - Gravar alterações pendentes na partição\n");
+        printf("  defrag [caminho]            - Tornar contíguas as cadeias dos arquivos\n");
+        printf("  fsck [-n]                   - Verificar e corrigir a FAT e os diretórios\n");
+        printf("  stats [reset]               - Mostrar (ou zerar) estatísticas de E/S e latência\n");
         printf("  help                        - Mostrar esta ajuda\n");
         printf("  exit                        - Sair do programa\n\n");
         
     } else if (strcmp(token, "exit") == 0) {
         printf("Saindo...\n");
+        fat16_close(fs);
         exit(0);
         
     } else {
@@ -51,6 +51,7 @@ ls /backup
 unlink /backup/backup.txt
 unlink /backup
 ls /
+sync
 exit
 EOF
 
@@ -0,0 +1,457 @@
+#include "../include/fat16.h"
+
+// Benchmark do núcleo, chamado direto pela biblioteca: operações de
+// metadados, vazão de escrita/anexação/leitura em vários tamanhos, busca
+// em caminhos profundos e um volume fragmentado e quase cheio, nos dois
+// modos de acesso. Cada medição sai numa linha de pares chave=valor, com
+// nomes fixos, para comparar execuções e detectar regressões:
+//
+//   backend=mmap bench=create ops=2000 ops_per_sec=... p50_us=... p99_us=...
+
+#define BENCH_PARTITION "tests/bench.part"
+#define BENCH_FILES 2000
+#define BENCH_DEPTH 16
+#define BENCH_LOOKUPS 20000
+#define BENCH_DATA_BYTES (8 << 20)      // Volume escrito por tamanho de arquivo
+#define BENCH_FRAG_FILE 2048            // Arquivos que enchem o volume fragmentado
+#define BENCH_FRAG_WRITE (32 * 1024)    // Arquivos gravados nos buracos
+#define BENCH_FULL_APPEND 1024
+
+typedef struct {
+    uint64_t *samples;      // Latência de cada operação, em ns
+    size_t count;
+    size_t capacity;
+    uint64_t bytes;         // Bytes transferidos (0 = só metadados)
+} series_t;
+
+static const char *backend_name;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int series_init(series_t *s, size_t capacity) {
+    s->samples = malloc(sizeof(uint64_t) * capacity);
+    s->count = 0;
+    s->capacity = capacity;
+    s->bytes = 0;
+    return s->samples ? 0 : -1;
+}
+
+static void series_add(series_t *s, uint64_t start, uint64_t bytes) {
+    if (s->count < s->capacity) {
+        s->samples[s->count++] = now_ns() - start;
+        s->bytes += bytes;
+    }
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Imprime a linha da medição (e campos extras já formatados) e libera a série
+static void report(series_t *s, const char *bench, const char *extra) {
+    uint64_t total = 0;
+    
+    if (s->count == 0) {
+        free(s->samples);
+        return;
+    }
+    
+    for (size_t i = 0; i < s->count; i++) {
+        total += s->samples[i];
+    }
+    qsort(s->samples, s->count, sizeof(uint64_t), compare_u64);
+    
+    double seconds = total / 1e9;
+    printf("backend=%s bench=%s ops=%zu ops_per_sec=%.0f p50_us=%.1f p99_us=%.1f",
+           backend_name, bench, s->count, s->count / seconds,
+           s->samples[s->count / 2] / 1e3, s->samples[(s->count * 99) / 100] / 1e3);
+    if (s->bytes > 0) {
+        printf(" mb_per_sec=%.1f", s->bytes / seconds / (1 << 20));
+    }
+    if (extra) {
+        printf(" %s", extra);
+    }
+    printf("\n");
+    
+    free(s->samples);
+}
+
+static int fail(const char *what, const char *path, fat16_error_t err) {
+    fprintf(stderr, "%s: %s %s: %s\n", backend_name, what, path, fat16_strerror(err));
+    return -1;
+}
+
+// Texto de 'len' bytes (fat16_write recebe uma string)
+static char *make_text(size_t len, char base) {
+    char *text = malloc(len + 1);
+    if (text) {
+        for (size_t i = 0; i < len; i++) {
+            text[i] = base + i % 26;
+        }
+        text[len] = '\0';
+    }
+    return text;
+}
+
+// Trechos contíguos na cadeia de um arquivo
+static uint32_t count_extents(fat16_fs_t *fs, const char *path) {
+    dir_entry_t entry;
+    uint32_t extents = 0;
+    uint32_t steps = 0;
+    uint16_t prev = 0;
+    
+    if (fat16_stat(fs, path, &entry) != FAT16_OK) {
+        return 0;
+    }
+    
+    for (uint16_t c = entry.first_block; c >= fs->data_start_cluster && c < fs->total_clusters &&
+         steps < fs->total_clusters; c = fs->fat[c], steps++) {
+        if (c != prev + 1) {
+            extents++;
+        }
+        prev = c;
+    }
+    
+    return extents;
+}
+
+// create, mkdir e unlink de arquivos e diretórios vazios num diretório
+static int bench_metadata(fat16_fs_t *fs) {
+    static const char *names[] = {"create", "mkdir", "unlink", "rmdir"};
+    char path[64];
+    fat16_error_t err;
+    
+    if ((err = fat16_mkdir(fs, "/meta")) != FAT16_OK) {
+        return fail("mkdir", "/meta", err);
+    }
+    
+    for (int phase = 0; phase < 4; phase++) {
+        series_t s;
+        if (series_init(&s, BENCH_FILES) != 0) {
+            return -1;
+        }
+        
+        for (int i = 0; i < BENCH_FILES; i++) {
+            snprintf(path, sizeof(path), "/meta/%c%d", phase % 2 == 0 ? 'f' : 'd', i);
+            
+            uint64_t start = now_ns();
+            switch (phase) {
+            case 0:
+                err = fat16_create(fs, path);
+                break;
+            case 1:
+                err = fat16_mkdir(fs, path);
+                break;
+            default:
+                err = fat16_unlink(fs, path);
+                break;
+            }
+            series_add(&s, start, 0);
+            
+            if (err != FAT16_OK) {
+                free(s.samples);
+                return fail(names[phase], path, err);
+            }
+        }
+        
+        report(&s, names[phase], NULL);
+    }
+    
+    return fat16_unlink(fs, "/meta") == FAT16_OK ? 0 : -1;
+}
+
+// write (sobrescrita), append e pread de arquivos de vários tamanhos
+static int bench_data(fat16_fs_t *fs) {
+    static const size_t sizes[] = {4 * 1024, 64 * 1024, 1024 * 1024};
+    char bench[32];
+    fat16_error_t err;
+    
+    if ((err = fat16_mkdir(fs, "/data")) != FAT16_OK) {
+        return fail("mkdir", "/data", err);
+    }
+    
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        size_t size = sizes[k];
+        size_t reps = BENCH_DATA_BYTES / size;
+        series_t s;
+        
+        if (reps > 256) {
+            reps = 256;
+        }
+        
+        char *text = make_text(size, 'a');
+        char *buffer = malloc(size);
+        if (!text || !buffer || fat16_create(fs, "/data/w") != FAT16_OK ||
+            fat16_create(fs, "/data/a") != FAT16_OK) {
+            free(text);
+            free(buffer);
+            return fail("create", "/data", FAT16_ERR_IO);
+        }
+        
+        // Sobrescrita do arquivo inteiro
+        series_init(&s, reps);
+        for (size_t i = 0; i < reps; i++) {
+            uint64_t start = now_ns();
+            err = fat16_write(fs, text, "/data/w");
+            series_add(&s, start, size);
+            if (err != FAT16_OK) {
+                break;
+            }
+        }
+        snprintf(bench, sizeof(bench), "write_%zuk", size / 1024);
+        report(&s, bench, NULL);
+        
+        // Anexação: o arquivo cresce até reps * size
+        series_init(&s, reps);
+        for (size_t i = 0; err == FAT16_OK && i < reps; i++) {
+            uint64_t start = now_ns();
+            err = fat16_append(fs, text, "/data/a");
+            series_add(&s, start, size);
+        }
+        snprintf(bench, sizeof(bench), "append_%zuk", size / 1024);
+        report(&s, bench, NULL);
+        
+        // Leitura de trechos de 'size' bytes do arquivo anexado
+        fat16_file_t *file = err == FAT16_OK ? fat16_open(fs, "/data/a") : NULL;
+        series_init(&s, reps);
+        for (size_t i = 0; file && i < reps; i++) {
+            uint64_t start = now_ns();
+            ssize_t n = fat16_pread(fs, file, buffer, size, i * size);
+            series_add(&s, start, size);
+            if (n != (ssize_t)size) {
+                err = FAT16_ERR_IO;
+                break;
+            }
+        }
+        snprintf(bench, sizeof(bench), "read_%zuk", size / 1024);
+        report(&s, bench, NULL);
+        
+        if (file) {
+            fat16_close_file(fs, file);
+        }
+        free(text);
+        free(buffer);
+        
+        if (err != FAT16_OK || !file) {
+            return fail("data", "/data", err != FAT16_OK ? err : FAT16_ERR_NOT_FOUND);
+        }
+        
+        fat16_unlink(fs, "/data/w");
+        fat16_unlink(fs, "/data/a");
+    }
+    
+    return fat16_unlink(fs, "/data") == FAT16_OK ? 0 : -1;
+}
+
+// stat de um arquivo e de um nome inexistente no fim de BENCH_DEPTH níveis
+static int bench_lookup(fat16_fs_t *fs) {
+    char path[256] = "";
+    char bench[32];
+    char missing[280];
+    fat16_error_t err;
+    dir_entry_t entry;
+    
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+        size_t len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, "/nivel%d", i);
+        if ((err = fat16_mkdir(fs, path)) != FAT16_OK) {
+            return fail("mkdir", path, err);
+        }
+    }
+    
+    snprintf(missing, sizeof(missing), "%s/ausente", path);
+    strncat(path, "/arquivo", sizeof(path) - strlen(path) - 1);
+    if ((err = fat16_create(fs, path)) != FAT16_OK) {
+        return fail("create", path, err);
+    }
+    
+    for (int miss = 0; miss < 2; miss++) {
+        series_t s;
+        if (series_init(&s, BENCH_LOOKUPS) != 0) {
+            return -1;
+        }
+        
+        for (int i = 0; i < BENCH_LOOKUPS; i++) {
+            uint64_t start = now_ns();
+            err = fat16_stat(fs, miss ? missing : path, &entry);
+            series_add(&s, start, 0);
+            
+            if (err != (miss ? FAT16_ERR_NOT_FOUND : FAT16_OK)) {
+                free(s.samples);
+                return fail("stat", miss ? missing : path, err);
+            }
+        }
+        
+        snprintf(bench, sizeof(bench), "lookup_depth%d%s", BENCH_DEPTH, miss ? "_miss" : "");
+        report(&s, bench, NULL);
+    }
+    
+    return 0;
+}
+
+// Enche o volume com arquivos pequenos, remove um a cada dois e grava
+// arquivos maiores nos buracos; depois anexa até o volume encher
+static int bench_fragmented(fat16_fs_t *fs) {
+    char path[64];
+    char extra[64];
+    fat16_error_t err = FAT16_OK;
+    int files = 0;
+    
+    char *small = make_text(BENCH_FRAG_FILE, 'a');
+    char *large = make_text(BENCH_FRAG_WRITE, 'A');
+    char *chunk = make_text(BENCH_FULL_APPEND, 'k');
+    char *buffer = malloc(BENCH_FRAG_WRITE);
+    if (!small || !large || !chunk || !buffer || (err = fat16_mkdir(fs, "/frag")) != FAT16_OK) {
+        free(small);
+        free(large);
+        free(chunk);
+        free(buffer);
+        return fail("mkdir", "/frag", err);
+    }
+    
+    // Preenchimento: para no primeiro erro de espaço
+    for (;; files++) {
+        snprintf(path, sizeof(path), "/frag/p%d", files);
+        if (fat16_create(fs, path) != FAT16_OK) {
+            break;
+        }
+        if (fat16_write(fs, small, path) != FAT16_OK) {
+            fat16_unlink(fs, path);
+            break;
+        }
+    }
+    
+    for (int i = 0; i < files; i += 2) {
+        snprintf(path, sizeof(path), "/frag/p%d", i);
+        fat16_unlink(fs, path);
+    }
+    
+    // Gravação nos buracos
+    int large_files = 0;
+    uint64_t extents = 0;
+    series_t s;
+    series_init(&s, files);
+    for (;; large_files++) {
+        snprintf(path, sizeof(path), "/frag/g%d", large_files);
+        if (fat16_create(fs, path) != FAT16_OK) {
+            break;
+        }
+        
+        uint64_t start = now_ns();
+        if (fat16_write(fs, large, path) != FAT16_OK) {
+            fat16_unlink(fs, path);
+            break;
+        }
+        series_add(&s, start, BENCH_FRAG_WRITE);
+        extents += count_extents(fs, path);
+    }
+    snprintf(extra, sizeof(extra), "extents_per_file=%.1f", large_files ? (double)extents / large_files : 0.0);
+    report(&s, "frag_write", extra);
+    
+    // Leitura dos arquivos fragmentados
+    series_init(&s, large_files);
+    for (int i = 0; i < large_files; i++) {
+        snprintf(path, sizeof(path), "/frag/g%d", i);
+        fat16_file_t *file = fat16_open(fs, path);
+        
+        uint64_t start = now_ns();
+        ssize_t n = file ? fat16_pread(fs, file, buffer, BENCH_FRAG_WRITE, 0) : -1;
+        series_add(&s, start, BENCH_FRAG_WRITE);
+        
+        if (file) {
+            fat16_close_file(fs, file);
+        }
+        if (n != BENCH_FRAG_WRITE) {
+            err = FAT16_ERR_IO;
+            break;
+        }
+    }
+    report(&s, "frag_read", NULL);
+    
+    // Volume quase cheio: anexa até faltar espaço
+    int appends = 0;
+    series_init(&s, 1 << 16);
+    if (err == FAT16_OK && (err = fat16_create(fs, "/frag/cheio")) == FAT16_OK) {
+        for (;; appends++) {
+            uint64_t start = now_ns();
+            fat16_error_t result = fat16_append(fs, chunk, "/frag/cheio");
+            if (result != FAT16_OK) {
+                if (result != FAT16_ERR_NO_SPACE) {
+                    err = result;
+                }
+                break;
+            }
+            series_add(&s, start, BENCH_FULL_APPEND);
+        }
+    }
+    fat16_fat_lock(fs);
+    snprintf(extra, sizeof(extra), "free_clusters=%u", (unsigned)fs->free_map.free_count);
+    fat16_fat_unlock(fs);
+    report(&s, "full_append", extra);
+    
+    free(small);
+    free(large);
+    free(chunk);
+    free(buffer);
+    return err == FAT16_OK ? 0 : fail("frag", "/frag", err);
+}
+
+// Roda as medições num backend. Metadados, dados e busca usam uma
+// partição de 64 MiB; o volume fragmentado, a geometria padrão (4 MiB)
+static int run(fat16_backend_t backend, const char *name) {
+    static fat16_fs_t fs;
+    fat16_error_t err;
+    int result = 0;
+    
+    backend_name = name;
+    memset(&fs, 0, sizeof(fs));
+    fs.backend = backend;
+    fs.format_cluster_size = 4096;
+    fs.format_total_clusters = 16384;
+    
+    if ((err = fat16_init(&fs, BENCH_PARTITION)) != FAT16_OK) {
+        return fail("init", BENCH_PARTITION, err);
+    }
+    
+    result |= bench_metadata(&fs);
+    result |= bench_data(&fs);
+    result |= bench_lookup(&fs);
+    
+    series_t s;
+    series_init(&s, 1);
+    uint64_t start = now_ns();
+    if (fat16_sync(&fs) != 0) {
+        result = -1;
+    }
+    series_add(&s, start, 0);
+    report(&s, "sync", NULL);
+    
+    fat16_close(&fs);
+    
+    fs.format_cluster_size = 0;
+    fs.format_total_clusters = 0;
+    if ((err = fat16_init(&fs, BENCH_PARTITION)) != FAT16_OK) {
+        return fail("init", BENCH_PARTITION, err);
+    }
+    
+    result |= bench_fragmented(&fs);
+    
+    fat16_close(&fs);
+    remove(BENCH_PARTITION);
+    return result;
+}
+
+int main(void) {
+    int result = 0;
+    
+    result |= run(FAT16_BACKEND_MMAP, "mmap");
+    result |= run(FAT16_BACKEND_STDIO, "stdio");
+    
+    return result == 0 ? 0 : 1;
+}
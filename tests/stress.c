@@ -0,0 +1,427 @@
+#include "../include/fat16.h"
+
+// Teste de concorrência: várias threads criam, escrevem, anexam, leem e
+// removem arquivos e diretórios na mesma partição, cada uma com um
+// diretório próprio e todas num diretório compartilhado. No fim confere o
+// conteúdo dos arquivos, a FAT (sem clusters em duas cadeias nem perdidos),
+// nomes que começam com o byte da lápide e repete a conferência depois de recarregar a partição
+
+#define STRESS_PARTITION "tests/stress.part"
+#define STRESS_THREADS 8
+#define STRESS_ITERATIONS 300
+#define STRESS_FILES 6
+#define STRESS_MAX_SIZE 6000
+
+// Nomes que começam com o byte 0xE5, o mesmo da lápide ("学", "学.txt")
+#define STRESS_E5_DIR "/\xe5\xad\xa6"
+#define STRESS_E5_FILE STRESS_E5_DIR "/\xe5\xad\xa6.txt"
+#define STRESS_E5_TEXT "conteúdo"
+
+typedef struct {
+    fat16_fs_t *fs;
+    int id;
+    unsigned int seed;
+    int failed;
+    char data[STRESS_FILES][STRESS_MAX_SIZE + 1];   // Conteúdo esperado
+    size_t size[STRESS_FILES];
+} worker_t;
+
+static int fail(worker_t *w, const char *what, const char *path, int err) {
+    fprintf(stderr, "thread %d: %s %s: %s\n", w->id, what, path, fat16_strerror(err));
+    w->failed = 1;
+    return -1;
+}
+
+// Texto pseudoaleatório (sem '\0', porque fat16_write recebe uma string)
+static void fill(worker_t *w, char *buffer, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buffer[i] = 'a' + rand_r(&w->seed) % 26;
+    }
+    buffer[len] = '\0';
+}
+
+// Confere o conteúdo de um arquivo pela leitura com handle
+static int check_file(fat16_fs_t *fs, const char *path, const char *expected, size_t size) {
+    fat16_file_t *file = fat16_open(fs, path);
+    if (!file) {
+        return -1;
+    }
+    
+    char *buffer = malloc(size + 1);
+    ssize_t n = buffer ? fat16_pread(fs, file, buffer, size + 1, 0) : -1;
+    int result = (n == (ssize_t)size && memcmp(buffer, expected, size) == 0) ? 0 : -1;
+    
+    free(buffer);
+    fat16_close_file(fs, file);
+    return result;
+}
+
+// Confere o conteúdo de um arquivo enviado para um descritor
+static int check_cat(fat16_fs_t *fs, const char *path, const char *expected, size_t size) {
+    FILE *tmp = tmpfile();
+    if (!tmp) {
+        return -1;
+    }
+    
+    uint32_t sent = 0;
+    char *buffer = malloc(size + 1);
+    int result = -1;
+    
+    if (buffer && fat16_cat(fs, path, fileno(tmp), &sent) == FAT16_OK && sent == size &&
+        pread(fileno(tmp), buffer, size + 1, 0) == (ssize_t)size && memcmp(buffer, expected, size) == 0) {
+        result = 0;
+    }
+    
+    free(buffer);
+    fclose(tmp);
+    return result;
+}
+
+// Operações sobre os arquivos do diretório da thread
+static int private_step(worker_t *w, int k) {
+    fat16_fs_t *fs = w->fs;
+    int f = rand_r(&w->seed) % STRESS_FILES;
+    char path[64];
+    char text[STRESS_MAX_SIZE + 1];
+    int err;
+    
+    snprintf(path, sizeof(path), "/t%d/f%d", w->id, f);
+    
+    switch (rand_r(&w->seed) % 6) {
+    case 0: {
+        // Sobrescreve
+        size_t len = rand_r(&w->seed) % (STRESS_MAX_SIZE / 2);
+        fill(w, text, len);
+        if ((err = fat16_write(fs, text, path)) != FAT16_OK) {
+            return fail(w, "write", path, err);
+        }
+        memcpy(w->data[f], text, len + 1);
+        w->size[f] = len;
+        break;
+    }
+    case 1: {
+        // Anexa
+        size_t len = rand_r(&w->seed) % 1500;
+        if (w->size[f] + len > STRESS_MAX_SIZE) {
+            len = STRESS_MAX_SIZE - w->size[f];
+        }
+        fill(w, text, len);
+        if ((err = fat16_append(fs, text, path)) != FAT16_OK) {
+            return fail(w, "append", path, err);
+        }
+        memcpy(w->data[f] + w->size[f], text, len + 1);
+        w->size[f] += len;
+        break;
+    }
+    case 2: {
+        // Escreve no meio pelo handle, possivelmente estendendo o arquivo
+        uint32_t offset = rand_r(&w->seed) % (w->size[f] + 1);
+        size_t len = 1 + rand_r(&w->seed) % 2000;
+        if (offset + len > STRESS_MAX_SIZE) {
+            len = STRESS_MAX_SIZE - offset;
+        }
+        fill(w, text, len);
+            
+        fat16_file_t *file = fat16_open(fs, path);
+        if (!file) {
+            return fail(w, "open", path, FAT16_ERR_NOT_FOUND);
+        }
+        ssize_t n = len > 0 ? fat16_pwrite(fs, file, text, len, offset) : 0;
+        fat16_close_file(fs, file);
+            
+        if (n != (ssize_t)len) {
+            return fail(w, "pwrite", path, FAT16_ERR_IO);
+        }
+        memcpy(w->data[f] + offset, text, len);
+        if (offset + len > w->size[f]) {
+            w->size[f] = offset + len;
+            w->data[f][w->size[f]] = '\0';
+        }
+        break;
+    }
+    case 3:
+        if (check_cat(fs, path, w->data[f], w->size[f]) != 0) {
+            return fail(w, "cat", path, FAT16_ERR_CORRUPT);
+        }
+        break;
+    case 4:
+        // Remove e recria vazio
+        if ((err = fat16_unlink(fs, path)) != FAT16_OK || (err = fat16_create(fs, path)) != FAT16_OK) {
+            return fail(w, "unlink/create", path, err);
+        }
+        w->size[f] = 0;
+        w->data[f][0] = '\0';
+        break;
+    case 5: {
+        // Cria e remove um subdiretório (rmdir trava toda a partição)
+        snprintf(path, sizeof(path), "/t%d/d%d", w->id, k);
+        if ((err = fat16_mkdir(fs, path)) != FAT16_OK) {
+            return fail(w, "mkdir", path, err);
+        }
+        char child[80];
+        snprintf(child, sizeof(child), "%s/x", path);
+        if ((err = fat16_create(fs, child)) != FAT16_OK ||
+            (err = fat16_unlink(fs, path)) != FAT16_ERR_NOT_EMPTY) {
+            return fail(w, "mkdir/rmdir", child, err);
+        }
+        if ((err = fat16_unlink(fs, child)) != FAT16_OK || (err = fat16_unlink(fs, path)) != FAT16_OK) {
+            return fail(w, "rmdir", path, err);
+        }
+        return 0;
+    }
+    }
+    
+    snprintf(path, sizeof(path), "/t%d/f%d", w->id, f);
+    if (check_file(fs, path, w->data[f], w->size[f]) != 0) {
+        return fail(w, "pread", path, FAT16_ERR_CORRUPT);
+    }
+    
+    return 0;
+}
+
+// Operações no diretório compartilhado: nomes únicos por thread e
+// listagens concorrentes
+static int shared_step(worker_t *w, int k) {
+    fat16_fs_t *fs = w->fs;
+    char path[64];
+    char text[256];
+    int err;
+    
+    snprintf(path, sizeof(path), "/shared/s%d_%d", w->id, k);
+    fill(w, text, rand_r(&w->seed) % 200);
+    
+    if ((err = fat16_create(fs, path)) != FAT16_OK || (err = fat16_write(fs, text, path)) != FAT16_OK) {
+        return fail(w, "create/write", path, err);
+    }
+    
+    if (check_file(fs, path, text, strlen(text)) != 0) {
+        return fail(w, "pread", path, FAT16_ERR_CORRUPT);
+    }
+    
+    fat16_dir_t dir;
+    dir_entry_t entry;
+    if ((err = fat16_opendir(fs, "/shared", &dir)) != FAT16_OK) {
+        return fail(w, "opendir", "/shared", err);
+    }
+    while ((err = fat16_readdir(fs, &dir, &entry)) > 0) {
+    }
+    if (err < 0) {
+        return fail(w, "readdir", "/shared", err);
+    }
+    
+    // Mantém metade dos arquivos até o fim
+    if (k % 2 == 0 && (err = fat16_unlink(fs, path)) != FAT16_OK) {
+        return fail(w, "unlink", path, err);
+    }
+    
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    
+    for (int k = 0; k < STRESS_ITERATIONS && !w->failed; k++) {
+        if (private_step(w, k) != 0 || shared_step(w, k) != 0) {
+            break;
+        }
+    }
+    
+    return NULL;
+}
+
+// Marca os clusters da cadeia; falha se algum já pertence a outra cadeia
+static int mark_chain(fat16_fs_t *fs, uint8_t *owner, uint16_t first, const char *path) {
+    uint32_t steps = 0;
+    
+    // Arquivo vazio, sem cadeia
+    if (first == 0) {
+        return 0;
+    }
+    
+    for (uint16_t c = first; c != FAT_END_OF_FILE; c = fs->fat[c]) {
+        if (c < fs->root_dir_cluster || c >= fs->total_clusters || ++steps > fs->total_clusters) {
+            fprintf(stderr, "cadeia inválida em %s\n", path);
+            return -1;
+        }
+        if (owner[c]) {
+            fprintf(stderr, "cluster %u de %s também está em outra cadeia\n", c, path);
+            return -1;
+        }
+        owner[c] = 1;
+    }
+    
+    return 0;
+}
+
+// Percorre a árvore marcando as cadeias de todas as entradas
+static int mark_tree(fat16_fs_t *fs, uint8_t *owner, const char *path, uint16_t cluster) {
+    if (mark_chain(fs, owner, cluster, path) != 0) {
+        return -1;
+    }
+    
+    fat16_dir_t dir;
+    dir_entry_t entry;
+    int more;
+    
+    if (fat16_opendir(fs, path, &dir) != FAT16_OK) {
+        return -1;
+    }
+    
+    while ((more = fat16_readdir(fs, &dir, &entry)) > 0) {
+        char child[256];
+        snprintf(child, sizeof(child), "%s/%.18s", strcmp(path, "/") == 0 ? "" : path, (char *)entry.filename);
+        
+        int result = entry.attributes == ATTR_DIRECTORY ? mark_tree(fs, owner, child, entry.first_block)
+                                                        : mark_chain(fs, owner, entry.first_block, child);
+        if (result != 0) {
+            return -1;
+        }
+    }
+    
+    return more;
+}
+
+// Confere conteúdo, listagens e FAT depois que as threads terminam
+// Os nomes com 0xE5 aparecem uma vez na listagem, não podem ser criados
+// de novo e o fsck não encontra problemas
+static int verify_e5(fat16_fs_t *fs) {
+    fat16_dir_t dir;
+    dir_entry_t entry;
+    fat16_fsck_report_t report;
+    int seen = 0;
+    int more;
+    
+    if (fat16_opendir(fs, "/", &dir) != FAT16_OK) {
+        return -1;
+    }
+    while ((more = fat16_readdir(fs, &dir, &entry)) > 0) {
+        seen += strncmp((char *)entry.filename, STRESS_E5_DIR + 1, MAX_FILENAME_SIZE) == 0;
+    }
+    
+    if (more < 0 || seen != 1 || fat16_mkdir(fs, STRESS_E5_DIR) != FAT16_ERR_EXISTS ||
+        check_file(fs, STRESS_E5_FILE, STRESS_E5_TEXT, strlen(STRESS_E5_TEXT)) != 0) {
+        fprintf(stderr, "nome iniciado por 0xE5 não encontrado ou duplicado\n");
+        return -1;
+    }
+    
+    if (fat16_fsck(fs, 0, &report) != FAT16_OK) {
+        fprintf(stderr, "fsck encontrou problemas\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int verify(fat16_fs_t *fs, worker_t *workers) {
+    char path[64];
+    
+    if (verify_e5(fs) != 0) {
+        return -1;
+    }
+    
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        for (int f = 0; f < STRESS_FILES; f++) {
+            snprintf(path, sizeof(path), "/t%d/f%d", i, f);
+            if (check_file(fs, path, workers[i].data[f], workers[i].size[f]) != 0) {
+                fprintf(stderr, "conteúdo incorreto em %s\n", path);
+                return -1;
+            }
+        }
+        
+        for (int k = 1; k < STRESS_ITERATIONS; k += 2) {
+            dir_entry_t entry;
+            snprintf(path, sizeof(path), "/shared/s%d_%d", i, k);
+            if (fat16_stat(fs, path, &entry) != FAT16_OK) {
+                fprintf(stderr, "%s não encontrado\n", path);
+                return -1;
+            }
+        }
+    }
+    
+    uint8_t *owner = calloc(fs->total_clusters, 1);
+    if (!owner || mark_tree(fs, owner, "/", fs->root_dir_cluster) != 0) {
+        free(owner);
+        return -1;
+    }
+    
+    // A área do journal, no fim da partição, não pertence a ninguém
+    uint32_t data_end = fs->journal.start ? fs->journal.start : fs->total_clusters;
+    for (uint32_t c = fs->data_start_cluster; c < data_end; c++) {
+        if ((fs->fat[c] != FAT_FREE) != owner[c]) {
+            fprintf(stderr, "cluster %u %s\n", c, owner[c] ? "em uso marcado como livre" : "perdido");
+            free(owner);
+            return -1;
+        }
+    }
+    
+    free(owner);
+    return 0;
+}
+
+static int run(fat16_backend_t backend, const char *name) {
+    static fat16_fs_t fs;
+    static worker_t workers[STRESS_THREADS];
+    pthread_t threads[STRESS_THREADS];
+    char path[64];
+    int result = 0;
+    
+    memset(&fs, 0, sizeof(fs));
+    memset(workers, 0, sizeof(workers));
+    fs.backend = backend;
+    fs.format_total_clusters = 16384;
+    
+    fat16_error_t err = fat16_init(&fs, STRESS_PARTITION);
+    if (err != FAT16_OK || (err = fat16_mkdir(&fs, "/shared")) != FAT16_OK ||
+        (err = fat16_mkdir(&fs, STRESS_E5_DIR)) != FAT16_OK || (err = fat16_create(&fs, STRESS_E5_FILE)) != FAT16_OK ||
+        (err = fat16_write(&fs, STRESS_E5_TEXT, STRESS_E5_FILE)) != FAT16_OK) {
+        fprintf(stderr, "%s: init: %s\n", name, fat16_strerror(err));
+        return -1;
+    }
+    
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        workers[i].fs = &fs;
+        workers[i].id = i;
+        workers[i].seed = 1234 + i;
+        
+        snprintf(path, sizeof(path), "/t%d", i);
+        fat16_mkdir(&fs, path);
+        for (int f = 0; f < STRESS_FILES; f++) {
+            snprintf(path, sizeof(path), "/t%d/f%d", i, f);
+            fat16_create(&fs, path);
+        }
+    }
+    
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        result |= workers[i].failed ? -1 : 0;
+    }
+    
+    if (result == 0 && verify(&fs, workers) != 0) {
+        result = -1;
+    }
+    
+    // A partição recarregada deve ter o mesmo conteúdo
+    fat16_close(&fs);
+    if (result == 0 && ((err = fat16_load(&fs, STRESS_PARTITION)) != FAT16_OK || verify(&fs, workers) != 0)) {
+        fprintf(stderr, "%s: conferência após recarregar falhou\n", name);
+        result = -1;
+    }
+    
+    fat16_close(&fs);
+    remove(STRESS_PARTITION);
+    
+    printf("%s: %s\n", name, result == 0 ? "ok" : "FALHOU");
+    return result;
+}
+
+int main(void) {
+    int result = 0;
+    
+    result |= run(FAT16_BACKEND_MMAP, "mmap");
+    result |= run(FAT16_BACKEND_STDIO, "stdio");
+    
+    return result == 0 ? 0 : 1;
+}